@@ -35,13 +35,30 @@ std::ifstream::pos_type filesize(const char* filename)
 }
 
 int main(int argc, char * const argv[]) {
+	auto access = FileAccess::READ;
+	bool readahead = false;
+	bool verify_crc = false;
 
 	for (int arg = 1; arg < argc; arg++) {
+		if (strcmp(argv[arg], "--mmap") == 0) {
+			access = FileAccess::MMAP;
+			continue;
+		}
+		if (strcmp(argv[arg], "--readahead") == 0) {
+			readahead = true;
+			continue;
+		}
+		if (strcmp(argv[arg], "--crc") == 0) {
+			verify_crc = true;
+			continue;
+		}
 		start();
-		auto f = ParquetFile(argv[arg]);
+		auto f = ParquetFile(argv[arg], access);
 
 		ResultChunk rc;
 		ScanState s;
+		s.readahead = readahead;
+		s.verify_crc = verify_crc;
 
 		f.initialize_result(rc);
 		uint64_t nrow = 0;
@@ -477,6 +477,7 @@ enum CompressionCodec {
   BROTLI = 4; // Added in 2.3.2
   LZ4 = 5;    // Added in 2.3.2
   ZSTD = 6;   // Added in 2.3.2
+  LZ4_RAW = 7; // Added in 2.9.0
 }
 
 enum PageType {
@@ -1,5 +1,15 @@
-#include <iostream>
 #include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
 
 #include "miniparquet.h"
 
@@ -11,6 +21,13 @@ constexpr int64_t kJulianToUnixEpochDays = 2440588LL;
 constexpr int64_t kMillisecondsInADay = 86400000LL;
 constexpr int64_t kNanosecondsInADay = kMillisecondsInADay * 1000LL * 1000LL;
 
+// rows that are formatted and written in one piece
+constexpr uint64_t SLICE_ROWS = 16384;
+// enough for any number, timestamp or short decimal
+constexpr size_t MAX_VALUE_LEN = 64;
+// widest FIXED_LEN_BYTE_ARRAY decimal, 38 digits need 16 bytes
+constexpr int MAX_DECIMAL_BYTES = 32;
+
 static int64_t impala_timestamp_to_nanoseconds(const Int96 &impala_timestamp) {
 	int64_t days_since_epoch = impala_timestamp.value[2]
 			- kJulianToUnixEpochDays;
@@ -19,105 +36,1262 @@ static int64_t impala_timestamp_to_nanoseconds(const Int96 &impala_timestamp) {
 	return days_since_epoch * kNanosecondsInADay + nanoseconds;
 }
 
-int main(int argc, char *const argv[]) {
+// formatted output of one slice, grows as needed and is reused
+class OutputBuffer {
+public:
+	// room for at least n more bytes
+	char* reserve(size_t n) {
+		if (len + n > data.size()) {
+			data.resize(max(data.size() * 2, len + n));
+		}
+		return &data[len];
+	}
+	void commit(char *end) {
+		len = end - data.data();
+	}
+	void append(const char *str, size_t n) {
+		memcpy(reserve(n), str, n);
+		len += n;
+	}
+	vector<char> data;
+	size_t len = 0;
+};
 
-	for (int arg = 1; arg < argc; arg++) {
-		auto f = ParquetFile(argv[arg]);
+static void write_all(int fd, const char *buf, size_t len) {
+	while (len > 0) {
+		auto written = write(fd, buf, len);
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			throw runtime_error(
+					string("Could not write output: ") + strerror(errno));
+		}
+		buf += written;
+		len -= written;
+	}
+}
 
-		ResultChunk rc;
-		ScanState s;
+static const char digit_pairs[] =
+		"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+		"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+		"8081828384858687888990919293949596979899";
+
+static char* format_uint(uint64_t val, char *out) {
+	char buf[20];
+	auto pos = buf + sizeof(buf);
+	while (val >= 100) {
+		pos -= 2;
+		memcpy(pos, digit_pairs + (val % 100) * 2, 2);
+		val /= 100;
+	}
+	if (val >= 10) {
+		pos -= 2;
+		memcpy(pos, digit_pairs + val * 2, 2);
+	} else {
+		*--pos = '0' + val;
+	}
+	auto len = buf + sizeof(buf) - pos;
+	memcpy(out, pos, len);
+	return out + len;
+}
+
+static char* format_int(int64_t val, char *out) {
+	if (val < 0) {
+		*out++ = '-';
+		return format_uint(0 - (uint64_t) val, out);
+	}
+	return format_uint(val, out);
+}
+
+// the decimal digits of an unscaled value with the last scale of them after the decimal point, at least
+// one digit before it
+static char* place_point(const char *digits, int len, int scale, char *out) {
+	if (scale == 0) {
+		memcpy(out, digits, len);
+		return out + len;
+	}
+	if (len <= scale) {
+		*out++ = '0';
+		*out++ = '.';
+		memset(out, '0', scale - len);
+		out += scale - len;
+		memcpy(out, digits, len);
+		return out + len;
+	}
+	memcpy(out, digits, len - scale);
+	out += len - scale;
+	*out++ = '.';
+	memcpy(out, digits + len - scale, scale);
+	return out + scale;
+}
+
+static char* format_fixed(uint64_t val, int scale, char *out) {
+	char buf[24];
+	return place_point(buf, format_uint(val, buf) - buf, scale, out);
+}
+
+// shortest decimal digits of floating point numbers with Grisu3 (Loitsch, "Printing Floating-Point
+// Numbers Quickly and Accurately with Integers"). It gives up on about 0.5% of numbers, where its
+// imprecision could make it miss the shortest digits, those go through printf and strtod.
+struct DiyFp {
+	uint64_t f;
+	int e;
+};
+
+static DiyFp multiply(const DiyFp &a, const DiyFp &b) {
+	const uint64_t mask = 0xffffffffULL;
+	uint64_t ac = (a.f >> 32) * (b.f >> 32);
+	uint64_t bc = (a.f & mask) * (b.f >> 32);
+	uint64_t ad = (a.f >> 32) * (b.f & mask);
+	uint64_t bd = (a.f & mask) * (b.f & mask);
+	// rounds the lower half
+	uint64_t tmp = (bd >> 32) + (ad & mask) + (bc & mask) + (1ULL << 31);
+	return {ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), a.e + b.e + 64};
+}
+
+static DiyFp normalize(DiyFp x) {
+	while (!(x.f >> 56)) {
+		x.f <<= 8;
+		x.e -= 8;
+	}
+	while (!(x.f >> 63)) {
+		x.f <<= 1;
+		x.e--;
+	}
+	return x;
+}
 
-		f.initialize_result(rc);
-
-		// TODO check for NULLness
-
-		while (f.scan(s, rc)) {
-			for (uint64_t row = 0; row < rc.nrows; row++) {
-				for (auto &col : rc.cols) {
-					if (!((uint8_t*) col.defined.ptr)[row]) {
-						printf("NULL");
-						if (col.id < rc.cols.size() - 1) {
-							printf("\t");
-						}
-						continue;
-					}
-					switch (col.col->type) {
-					case parquet::format::Type::BOOLEAN:
-						printf("%s",
-								((bool*) col.data.ptr)[row] ? "True" : "False");
-						break;
-
-					case parquet::format::Type::INT32:
-						printf("%d", ((int32_t*) col.data.ptr)[row]);
-						break;
-					case parquet::format::Type::INT64:
-						printf("%lld", ((int64_t*) col.data.ptr)[row]);
-						break;
-					case parquet::format::Type::INT96: {
-						// TODO when is this a timestamp?
-						auto val = ((Int96*) col.data.ptr)[row];
-						time_t a = impala_timestamp_to_nanoseconds(val)
-								/ 1000000000;
-						char buffer[80];
-						strftime(buffer, 80, "%Y-%m-%d %H:%M:%S", gmtime(&a));
-						printf("%s", buffer);
-						break;
-					}
-					case parquet::format::Type::FLOAT:
-						printf("%f", ((float*) col.data.ptr)[row]);
-						break;
-					case parquet::format::Type::DOUBLE:
-						printf("%lf", ((double*) col.data.ptr)[row]);
-						break;
-					case parquet::format::Type::FIXED_LEN_BYTE_ARRAY: {
-						auto &s_ele = col.col->schema_element;
-
-						if (!s_ele->__isset.converted_type) {
-							throw runtime_error("Invalid flba type");
-
-						}
-
-						// TODO what about logical_type??
-						switch (col.col->schema_element->converted_type) {
-						case parquet::format::ConvertedType::DECIMAL: { // this is a giant clusterfuck
-							auto type_len = s_ele->type_length;
-							auto bytes = ((char**) col.data.ptr)[row];
-							int64_t val = 0;
-							for (auto i = 0; i < type_len; i++) {
-								val = val << ((type_len - i) * 8)
-										| (uint8_t) bytes[i];
-							}
-							printf("%.2f", val / pow(10.0, s_ele->scale));
-
-						}
-							break;
-						default:
-							throw runtime_error("Invalid flba type");
-
-						}
-
-					}
-						break;
-					case parquet::format::Type::BYTE_ARRAY:
-						printf("%s", ((char**) col.data.ptr)[row]);
-
-						break;
-
-					default:
-						throw runtime_error("Invalid type");
-						break;
-
-					}
-					if (col.id < rc.cols.size() - 1) {
-						printf("\t");
-					}
+// 10^(-348 + 8 i), rounded to 64 bits
+static const DiyFp cached_powers[] = {
+		{ 0xfa8fd5a0081c0288ULL, -1220 }, { 0xbaaee17fa23ebf76ULL, -1193 },
+		{ 0x8b16fb203055ac76ULL, -1166 }, { 0xcf42894a5dce35eaULL, -1140 },
+		{ 0x9a6bb0aa55653b2dULL, -1113 }, { 0xe61acf033d1a45dfULL, -1087 },
+		{ 0xab70fe17c79ac6caULL, -1060 }, { 0xff77b1fcbebcdc4fULL, -1034 },
+		{ 0xbe5691ef416bd60cULL, -1007 }, { 0x8dd01fad907ffc3cULL, -980 },
+		{ 0xd3515c2831559a83ULL, -954 }, { 0x9d71ac8fada6c9b5ULL, -927 },
+		{ 0xea9c227723ee8bcbULL, -901 }, { 0xaecc49914078536dULL, -874 },
+		{ 0x823c12795db6ce57ULL, -847 }, { 0xc21094364dfb5637ULL, -821 },
+		{ 0x9096ea6f3848984fULL, -794 }, { 0xd77485cb25823ac7ULL, -768 },
+		{ 0xa086cfcd97bf97f4ULL, -741 }, { 0xef340a98172aace5ULL, -715 },
+		{ 0xb23867fb2a35b28eULL, -688 }, { 0x84c8d4dfd2c63f3bULL, -661 },
+		{ 0xc5dd44271ad3cdbaULL, -635 }, { 0x936b9fcebb25c996ULL, -608 },
+		{ 0xdbac6c247d62a584ULL, -582 }, { 0xa3ab66580d5fdaf6ULL, -555 },
+		{ 0xf3e2f893dec3f126ULL, -529 }, { 0xb5b5ada8aaff80b8ULL, -502 },
+		{ 0x87625f056c7c4a8bULL, -475 }, { 0xc9bcff6034c13053ULL, -449 },
+		{ 0x964e858c91ba2655ULL, -422 }, { 0xdff9772470297ebdULL, -396 },
+		{ 0xa6dfbd9fb8e5b88fULL, -369 }, { 0xf8a95fcf88747d94ULL, -343 },
+		{ 0xb94470938fa89bcfULL, -316 }, { 0x8a08f0f8bf0f156bULL, -289 },
+		{ 0xcdb02555653131b6ULL, -263 }, { 0x993fe2c6d07b7facULL, -236 },
+		{ 0xe45c10c42a2b3b06ULL, -210 }, { 0xaa242499697392d3ULL, -183 },
+		{ 0xfd87b5f28300ca0eULL, -157 }, { 0xbce5086492111aebULL, -130 },
+		{ 0x8cbccc096f5088ccULL, -103 }, { 0xd1b71758e219652cULL, -77 },
+		{ 0x9c40000000000000ULL, -50 }, { 0xe8d4a51000000000ULL, -24 },
+		{ 0xad78ebc5ac620000ULL, 3 }, { 0x813f3978f8940984ULL, 30 },
+		{ 0xc097ce7bc90715b3ULL, 56 }, { 0x8f7e32ce7bea5c70ULL, 83 },
+		{ 0xd5d238a4abe98068ULL, 109 }, { 0x9f4f2726179a2245ULL, 136 },
+		{ 0xed63a231d4c4fb27ULL, 162 }, { 0xb0de65388cc8ada8ULL, 189 },
+		{ 0x83c7088e1aab65dbULL, 216 }, { 0xc45d1df942711d9aULL, 242 },
+		{ 0x924d692ca61be758ULL, 269 }, { 0xda01ee641a708deaULL, 295 },
+		{ 0xa26da3999aef774aULL, 322 }, { 0xf209787bb47d6b85ULL, 348 },
+		{ 0xb454e4a179dd1877ULL, 375 }, { 0x865b86925b9bc5c2ULL, 402 },
+		{ 0xc83553c5c8965d3dULL, 428 }, { 0x952ab45cfa97a0b3ULL, 455 },
+		{ 0xde469fbd99a05fe3ULL, 481 }, { 0xa59bc234db398c25ULL, 508 },
+		{ 0xf6c69a72a3989f5cULL, 534 }, { 0xb7dcbf5354e9beceULL, 561 },
+		{ 0x88fcf317f22241e2ULL, 588 }, { 0xcc20ce9bd35c78a5ULL, 614 },
+		{ 0x98165af37b2153dfULL, 641 }, { 0xe2a0b5dc971f303aULL, 667 },
+		{ 0xa8d9d1535ce3b396ULL, 694 }, { 0xfb9b7cd9a4a7443cULL, 720 },
+		{ 0xbb764c4ca7a44410ULL, 747 }, { 0x8bab8eefb6409c1aULL, 774 },
+		{ 0xd01fef10a657842cULL, 800 }, { 0x9b10a4e5e9913129ULL, 827 },
+		{ 0xe7109bfba19c0c9dULL, 853 }, { 0xac2820d9623bf429ULL, 880 },
+		{ 0x80444b5e7aa7cf85ULL, 907 }, { 0xbf21e44003acdd2dULL, 933 },
+		{ 0x8e679c2f5e44ff8fULL, 960 }, { 0xd433179d9c8cb841ULL, 986 },
+		{ 0x9e19db92b4e31ba9ULL, 1013 }, { 0xeb96bf6ebadf77d9ULL, 1039 },
+		{ 0xaf87023b9bf0ee6bULL, 1066 }
+};
 
+static const uint64_t pow10_table[] = { 1ULL, 10ULL, 100ULL, 1000ULL,
+		10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL,
+		1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+		10000000000000ULL, 100000000000000ULL, 1000000000000000ULL,
+		10000000000000000ULL, 100000000000000000ULL, 1000000000000000000ULL,
+		10000000000000000000ULL };
+
+// moves the last digit towards w while that stays inside the rounding interval, false if the result
+// might not be the closest digits or not read back as w
+static bool round_weed(char *digits, int len, uint64_t distance_too_high_w,
+		uint64_t unsafe_interval, uint64_t rest, uint64_t ten_kappa,
+		uint64_t unit) {
+	uint64_t small_distance = distance_too_high_w - unit;
+	uint64_t big_distance = distance_too_high_w + unit;
+	while (rest < small_distance && unsafe_interval - rest >= ten_kappa
+			&& (rest + ten_kappa < small_distance
+					|| small_distance - rest >= rest + ten_kappa - small_distance)) {
+		digits[len - 1]--;
+		rest += ten_kappa;
+	}
+	if (rest < big_distance && unsafe_interval - rest >= ten_kappa
+			&& (rest + ten_kappa < big_distance
+					|| big_distance - rest > rest + ten_kappa - big_distance)) {
+		return false;
+	}
+	return 2 * unit <= rest && rest <= unsafe_interval - 4 * unit;
+}
+
+// the digits of w, as few as the interval between low and high allows
+static bool digit_gen(const DiyFp &low, const DiyFp &w, const DiyFp &high,
+		char *digits, int &len, int &kappa) {
+	uint64_t unit = 1;
+	uint64_t too_high = high.f + unit;
+	uint64_t unsafe_interval = too_high - (low.f - unit);
+	const DiyFp one = { 1ULL << -w.e, w.e };
+	auto integrals = (uint32_t) (too_high >> -one.e);
+	uint64_t fractionals = too_high & (one.f - 1);
+	kappa = 1;
+	while (kappa < 10 && integrals >= pow10_table[kappa]) {
+		kappa++;
+	}
+	len = 0;
+	while (kappa > 0) {
+		auto divisor = pow10_table[kappa - 1];
+		digits[len++] = '0' + integrals / divisor;
+		integrals %= divisor;
+		kappa--;
+		uint64_t rest = ((uint64_t) integrals << -one.e) + fractionals;
+		if (rest < unsafe_interval) {
+			return round_weed(digits, len, too_high - w.f, unsafe_interval,
+					rest, divisor << -one.e, unit);
+		}
+	}
+	while (true) {
+		fractionals *= 10;
+		unit *= 10;
+		unsafe_interval *= 10;
+		digits[len++] = '0' + (char) (fractionals >> -one.e);
+		fractionals &= one.f - 1;
+		kappa--;
+		if (fractionals < unsafe_interval) {
+			return round_weed(digits, len, (too_high - w.f) * unit,
+					unsafe_interval, fractionals, one.f, unit);
+		}
+	}
+}
+
+// the value is f * 2^e, lower_closer if the next smaller number is only half as far away as the
+// next larger one. The result is digits * 10^k, false if grisu3 cannot vouch for it.
+static bool grisu3(uint64_t f, int e, bool lower_closer, char *digits,
+		int &len, int &k) {
+	auto w = normalize( { f, e });
+	auto plus = normalize( { (f << 1) + 1, e - 1 });
+	DiyFp minus =
+			lower_closer ?
+					DiyFp { (f << 2) - 1, e - 2 } : DiyFp { (f << 1) - 1, e - 1 };
+	minus.f <<= minus.e - plus.e;
+	minus.e = plus.e;
+
+	// a power of ten that brings the binary exponent of the products into [-60, -32]
+	double dk = (-61 - plus.e) * 0.30102999566398114 + 347;
+	int power_k = (int) dk;
+	if (dk - power_k > 0.0) {
+		power_k++;
+	}
+	auto &c_mk = cached_powers[(power_k >> 3) + 1];
+	int kappa;
+	if (!digit_gen(multiply(minus, c_mk), multiply(w, c_mk),
+			multiply(plus, c_mk), digits, len, kappa)) {
+		return false;
+	}
+	k = -348 + ((power_k >> 3) + 1) * 8;
+	k = kappa - k;
+	return true;
+}
+
+// shortest digits that read back as val, nearest to it if there are several, with printf
+static void shortest_digits_slow(double val, bool is_float, char *digits,
+		int &len, int &k) {
+	char buf[MAX_VALUE_LEN];
+	for (int precision = 1; precision <= 17; precision++) {
+		// d.ddde[+-]x, rounded to nearest
+		snprintf(buf, sizeof(buf), "%.*e", precision - 1, val);
+		len = 0;
+		for (auto pos = buf; *pos != 'e'; pos++) {
+			if (*pos != '.') {
+				digits[len++] = *pos;
+			}
+		}
+		k = atoi(strchr(buf, 'e') + 1) - (len - 1);
+		for (int candidate = 0; candidate < 2; candidate++) {
+			if (candidate == 1) {
+				// the interval below val can be half as wide as the one above, so the next larger
+				// digits may read back while the nearest do not
+				auto pos = len - 1;
+				while (pos >= 0 && digits[pos] == '9') {
+					digits[pos--] = '0';
+				}
+				if (pos < 0) {
+					break;
 				}
-				printf("\n");
+				digits[pos]++;
 			}
+			snprintf(buf, sizeof(buf), "%.*se%d", len, digits, k);
+			if (is_float ?
+					strtof(buf, nullptr) == (float) val :
+					strtod(buf, nullptr) == val) {
+				while (len > 1 && digits[len - 1] == '0') {
+					len--;
+					k++;
+				}
+				return;
+			}
+		}
+	}
+}
+
+// digits * 10^k laid out like Python's repr(), which is what pandas writes
+static char* format_digits(const char *digits, int len, int k, char *out) {
+	int point = len + k;
+	if (point > -4 && point <= 16) {
+		if (point <= 0) {
+			*out++ = '0';
+			*out++ = '.';
+			memset(out, '0', -point);
+			out += -point;
+			memcpy(out, digits, len);
+			return out + len;
+		}
+		if (point >= len) {
+			memcpy(out, digits, len);
+			out += len;
+			memset(out, '0', point - len);
+			out += point - len;
+			*out++ = '.';
+			*out++ = '0';
+			return out;
+		}
+		memcpy(out, digits, point);
+		out += point;
+		*out++ = '.';
+		memcpy(out, digits + point, len - point);
+		return out + len - point;
+	}
+	*out++ = digits[0];
+	if (len > 1) {
+		*out++ = '.';
+		memcpy(out, digits + 1, len - 1);
+		out += len - 1;
+	}
+	*out++ = 'e';
+	int exponent = point - 1;
+	if (exponent < 0) {
+		*out++ = '-';
+		exponent = -exponent;
+	} else {
+		*out++ = '+';
+	}
+	if (exponent < 10) {
+		*out++ = '0';
+	}
+	return format_uint(exponent, out);
+}
+
+static char* format_special(bool negative, bool zero, bool nan, char *out) {
+	if (nan) {
+		memcpy(out, "nan", 3);
+		return out + 3;
+	}
+	if (negative) {
+		*out++ = '-';
+	}
+	if (zero) {
+		memcpy(out, "0.0", 3);
+	} else {
+		memcpy(out, "inf", 3);
+	}
+	return out + 3;
+}
+
+static char* format_double(double val, char *out) {
+	uint64_t bits;
+	memcpy(&bits, &val, sizeof(bits));
+	bool negative = bits >> 63;
+	uint64_t exponent = (bits >> 52) & 0x7ff;
+	uint64_t significand = bits & ((1ULL << 52) - 1);
+	if (exponent == 0x7ff || (exponent == 0 && significand == 0)) {
+		return format_special(negative, exponent == 0, significand != 0
+				&& exponent == 0x7ff, out);
+	}
+	if (negative) {
+		*out++ = '-';
+	}
+	char digits[24];
+	int len, k;
+	bool exact = exponent == 0 ?
+			grisu3(significand, -1074, false, digits, len, k) :
+			grisu3(significand | (1ULL << 52), exponent - 1075,
+					significand == 0 && exponent > 1, digits, len, k);
+	if (!exact) {
+		shortest_digits_slow(fabs(val), false, digits, len, k);
+	}
+	return format_digits(digits, len, k, out);
+}
+
+static char* format_float(float val, char *out) {
+	uint32_t bits;
+	memcpy(&bits, &val, sizeof(bits));
+	bool negative = bits >> 31;
+	uint32_t exponent = (bits >> 23) & 0xff;
+	uint32_t significand = bits & ((1U << 23) - 1);
+	if (exponent == 0xff || (exponent == 0 && significand == 0)) {
+		return format_special(negative, exponent == 0, significand != 0
+				&& exponent == 0xff, out);
+	}
+	if (negative) {
+		*out++ = '-';
+	}
+	char digits[24];
+	int len, k;
+	bool exact = exponent == 0 ?
+			grisu3(significand, -149, false, digits, len, k) :
+			grisu3(significand | (1U << 23), (int) exponent - 150,
+					significand == 0 && exponent > 1, digits, len, k);
+	if (!exact) {
+		shortest_digits_slow(fabs(val), true, digits, len, k);
+	}
+	return format_digits(digits, len, k, out);
+}
+
+static char* format_two_digits(int val, char *out) {
+	memcpy(out, digit_pairs + val * 2, 2);
+	return out + 2;
+}
+
+// formats a non-NULL value of a column
+typedef void (*format_fn)(const ResultColumn &col, uint64_t row,
+		OutputBuffer &out);
+
+static void format_boolean(const ResultColumn &col, uint64_t row,
+		OutputBuffer &out) {
+	if (((bool*) col.data.ptr)[row]) {
+		out.append("True", 4);
+	} else {
+		out.append("False", 5);
+	}
+}
+
+static void format_int32(const ResultColumn &col, uint64_t row,
+		OutputBuffer &out) {
+	out.commit(format_int(((int32_t*) col.data.ptr)[row], out.reserve(MAX_VALUE_LEN)));
+}
+
+static void format_int64(const ResultColumn &col, uint64_t row,
+		OutputBuffer &out) {
+	out.commit(format_int(((int64_t*) col.data.ptr)[row], out.reserve(MAX_VALUE_LEN)));
+}
+
+static void format_uint32(const ResultColumn &col, uint64_t row,
+		OutputBuffer &out) {
+	out.commit(format_uint(((uint32_t*) col.data.ptr)[row], out.reserve(MAX_VALUE_LEN)));
+}
+
+static void format_uint64(const ResultColumn &col, uint64_t row,
+		OutputBuffer &out) {
+	out.commit(format_uint(((uint64_t*) col.data.ptr)[row], out.reserve(MAX_VALUE_LEN)));
+}
+
+// YYYY-MM-DD HH:MM:SS in UTC
+static void format_int96(const ResultColumn &col, uint64_t row,
+		OutputBuffer &out) {
+	// TODO when is this a timestamp?
+	auto secs = impala_timestamp_to_nanoseconds(((Int96*) col.data.ptr)[row])
+			/ 1000000000;
+	auto days = secs / 86400;
+	auto day_secs = secs % 86400;
+	if (day_secs < 0) {
+		day_secs += 86400;
+		days--;
+	}
+	// civil date from days since 1970-01-01, in 400 year eras starting at March 1st
+	auto z = days + 719468;
+	auto era = (z >= 0 ? z : z - 146096) / 146097;
+	auto doe = z - era * 146097;
+	auto yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	auto doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	auto mp = (5 * doy + 2) / 153;
+	int day = doy - (153 * mp + 2) / 5 + 1;
+	int month = mp < 10 ? mp + 3 : mp - 9;
+	auto year = yoe + era * 400 + (month <= 2);
 
+	auto pos = out.reserve(MAX_VALUE_LEN);
+	if (year >= 0 && year < 10000) {
+		pos = format_two_digits(year / 100, pos);
+		pos = format_two_digits(year % 100, pos);
+	} else {
+		pos = format_int(year, pos);
+	}
+	*pos++ = '-';
+	pos = format_two_digits(month, pos);
+	*pos++ = '-';
+	pos = format_two_digits(day, pos);
+	*pos++ = ' ';
+	pos = format_two_digits(day_secs / 3600, pos);
+	*pos++ = ':';
+	pos = format_two_digits(day_secs / 60 % 60, pos);
+	*pos++ = ':';
+	pos = format_two_digits(day_secs % 60, pos);
+	out.commit(pos);
+}
+
+static void format_float_col(const ResultColumn &col, uint64_t row,
+		OutputBuffer &out) {
+	out.commit(format_float(((float*) col.data.ptr)[row], out.reserve(MAX_VALUE_LEN)));
+}
+
+static void format_double_col(const ResultColumn &col, uint64_t row,
+		OutputBuffer &out) {
+	out.commit(format_double(((double*) col.data.ptr)[row], out.reserve(MAX_VALUE_LEN)));
+}
+
+// big-endian two's complement unscaled value
+static void format_decimal(const ResultColumn &col, uint64_t row,
+		OutputBuffer &out) {
+	auto &s_ele = *col.col->schema_element;
+	auto bytes = (const uint8_t*) ((char**) col.data.ptr)[row];
+	auto type_len = s_ele.type_length;
+	if (type_len <= 8) {
+		uint64_t val = type_len > 0 && (int8_t) bytes[0] < 0 ? ~0ULL : 0;
+		for (auto i = 0; i < type_len; i++) {
+			val = val << 8 | bytes[i];
+		}
+		auto pos = out.reserve(MAX_VALUE_LEN + s_ele.scale);
+		if ((int64_t) val < 0) {
+			*pos++ = '-';
+			val = 0 - val;
 		}
+		out.commit(format_fixed(val, s_ele.scale, pos));
+		return;
+	}
+	// wider than 64 bits: the magnitude is divided by 10^9 until it is zero, nine digits at a time
+	uint8_t magnitude[MAX_DECIMAL_BYTES];
+	bool negative = (int8_t) bytes[0] < 0;
+	unsigned carry = 1;
+	for (auto i = type_len - 1; i >= 0; i--) {
+		unsigned byte = negative ? (uint8_t) ~bytes[i] + carry : bytes[i];
+		magnitude[i] = byte;
+		carry = byte >> 8;
+	}
+	char buf[MAX_DECIMAL_BYTES * 3];
+	auto end = buf + sizeof(buf);
+	auto pos = end;
+	auto first = 0;
+	while (first < type_len) {
+		uint64_t rem = 0;
+		for (auto i = first; i < type_len; i++) {
+			auto cur = rem << 8 | magnitude[i];
+			magnitude[i] = cur / 1000000000;
+			rem = cur % 1000000000;
+		}
+		while (first < type_len && magnitude[first] == 0) {
+			first++;
+		}
+		for (int digit = 0; digit < 9 && (rem > 0 || first < type_len);
+				digit++) {
+			*--pos = '0' + rem % 10;
+			rem /= 10;
+		}
+	}
+	if (pos == end) {
+		*--pos = '0';
+	}
+	auto dest = out.reserve(MAX_VALUE_LEN + sizeof(buf) + s_ele.scale);
+	if (negative) {
+		*dest++ = '-';
+	}
+	out.commit(place_point(pos, end - pos, s_ele.scale, dest));
+}
+
+// like RFC 4180: strings with the delimiter, a quote or a line break are quoted and their quotes doubled
+static void format_string(const char *str, const string &delimiter,
+		OutputBuffer &out) {
+	auto len = strlen(str);
+	if (!strpbrk(str, "\"\r\n")
+			&& (delimiter.empty() || !strstr(str, delimiter.c_str()))) {
+		out.append(str, len);
+		return;
+	}
+	out.append("\"", 1);
+	for (auto quote = strchr(str, '"'); quote; quote = strchr(str, '"')) {
+		out.append(str, quote - str + 1);
+		out.append("\"", 1);
+		str = quote + 1;
+	}
+	out.append(str, strlen(str));
+	out.append("\"", 1);
+}
+
+// INT32 and INT64 columns that hold unsigned integers
+static bool unsigned_integer(const parquet::format::SchemaElement &s_ele) {
+	if (s_ele.__isset.logicalType && s_ele.logicalType.__isset.INTEGER) {
+		return !s_ele.logicalType.INTEGER.isSigned;
+	}
+	if (!s_ele.__isset.converted_type) {
+		return false;
+	}
+	switch (s_ele.converted_type) {
+	case parquet::format::ConvertedType::UINT_8:
+	case parquet::format::ConvertedType::UINT_16:
+	case parquet::format::ConvertedType::UINT_32:
+	case parquet::format::ConvertedType::UINT_64:
+		return true;
+	default:
+		return false;
+	}
+}
 
+static format_fn column_formatter(const ParquetColumn &col) {
+	switch (col.type) {
+	case parquet::format::Type::BOOLEAN:
+		return format_boolean;
+	case parquet::format::Type::INT32:
+		return unsigned_integer(*col.schema_element) ?
+				format_uint32 : format_int32;
+	case parquet::format::Type::INT64:
+		return unsigned_integer(*col.schema_element) ?
+				format_uint64 : format_int64;
+	case parquet::format::Type::INT96:
+		return format_int96;
+	case parquet::format::Type::FLOAT:
+		return format_float_col;
+	case parquet::format::Type::DOUBLE:
+		return format_double_col;
+	case parquet::format::Type::FIXED_LEN_BYTE_ARRAY: {
+		auto &s_ele = col.schema_element;
+		// TODO what about logical_type??
+		if (!s_ele->__isset.converted_type
+				|| s_ele->converted_type
+						!= parquet::format::ConvertedType::DECIMAL) {
+			throw runtime_error("Invalid flba type");
+		}
+		if (s_ele->type_length > MAX_DECIMAL_BYTES) {
+			throw runtime_error("Decimal column " + col.name + " is too wide");
+		}
+		// the scale comes from the footer and sizes the output, it can be at most the number
+		// of digits the unscaled value has, about 8 * type_length * log10(2) of them
+		auto max_scale = (8 * s_ele->type_length * 1233 >> 12) + 1;
+		if (s_ele->scale < 0 || s_ele->scale > max_scale
+				|| (s_ele->__isset.precision
+						&& s_ele->scale > s_ele->precision)) {
+			throw runtime_error(
+					"Invalid scale " + to_string(s_ele->scale)
+							+ " of decimal column " + col.name);
+		}
+		return format_decimal;
+	}
+	case parquet::format::Type::BYTE_ARRAY:
+		// quoting needs the delimiter, format_rows does these
+		return nullptr;
+	default:
+		throw runtime_error("Invalid type");
 	}
+}
+
+struct Options {
+	// output columns by name, all if empty
+	vector<string> columns;
+	vector<string> where;
+	// rows to skip and to write, counted over all files
+	uint64_t offset = 0;
+	uint64_t limit = UINT64_MAX;
+	unsigned threads = thread::hardware_concurrency();
+	string delimiter = "\t";
+	string null_value = "NULL";
+};
 
+enum class Op {
+	EQ, NE, LT, LE, GT, GE
+};
+
+// column op value from --where. Rows where the column is NULL never match.
+struct Condition {
+	string column;
+	uint64_t col_idx;
+	// index of the column in the scanned chunk
+	uint64_t result_idx;
+	Op op;
+	parquet::format::Type::type type;
+	// INT32 and INT64 columns only, int_value then holds an uint64_t
+	bool is_unsigned;
+	int64_t int_value;
+	double double_value;
+	string string_value;
+	// whether the statistics of the column are ordered like our comparison
+	bool use_statistics;
+};
+
+// comparison results, UNORDERED for NaN
+constexpr int UNORDERED = 2;
+
+template<class T>
+static int three_way(T a, T b) {
+	return a < b ? -1 : (b < a ? 1 : 0);
+}
+
+static string trim(const string &str) {
+	auto start = str.find_first_not_of(" \t");
+	if (start == string::npos) {
+		return "";
+	}
+	return str.substr(start, str.find_last_not_of(" \t") - start + 1);
+}
+
+static Condition parse_condition(const string &text, ParquetFile &f) {
+	const pair<const char*, Op> ops[] = { { "==", Op::EQ }, { "!=", Op::NE },
+			{ "<=", Op::LE }, { ">=", Op::GE }, { "=", Op::EQ }, { "<", Op::LT },
+			{ ">", Op::GT } };
+	auto op_pos = text.find_first_of("=!<>");
+	if (op_pos == string::npos) {
+		throw runtime_error("Condition " + text + " has no operator");
+	}
+	Condition cond;
+	size_t op_len = 0;
+	for (auto &candidate : ops) {
+		if (text.compare(op_pos, strlen(candidate.first), candidate.first)
+				== 0) {
+			cond.op = candidate.second;
+			op_len = strlen(candidate.first);
+			break;
+		}
+	}
+	if (op_len == 0) {
+		throw runtime_error("Condition " + text + " has no operator");
+	}
+	cond.column = trim(text.substr(0, op_pos));
+	auto value = trim(text.substr(op_pos + op_len));
+	if (value.size() >= 2 && (value[0] == '\'' || value[0] == '"')
+			&& value.back() == value[0]) {
+		value = value.substr(1, value.size() - 2);
+	}
+
+	cond.col_idx = f.columns.size();
+	for (uint64_t col_idx = 0; col_idx < f.columns.size(); col_idx++) {
+		if (f.columns[col_idx]->name == cond.column) {
+			cond.col_idx = col_idx;
+		}
+	}
+	if (cond.col_idx == f.columns.size()) {
+		throw runtime_error("No column " + cond.column);
+	}
+	auto &col = *f.columns[cond.col_idx];
+	auto &s_ele = *col.schema_element;
+	cond.type = col.type;
+	cond.is_unsigned = false;
+	cond.use_statistics = true;
+	char *end = nullptr;
+	switch (col.type) {
+	case parquet::format::Type::BOOLEAN:
+		if (value == "true" || value == "True" || value == "1") {
+			cond.int_value = 1;
+		} else if (value == "false" || value == "False" || value == "0") {
+			cond.int_value = 0;
+		} else {
+			throw runtime_error("Invalid boolean " + value);
+		}
+		break;
+	case parquet::format::Type::INT32:
+	case parquet::format::Type::INT64:
+		errno = 0;
+		cond.is_unsigned = unsigned_integer(s_ele);
+		if (cond.is_unsigned) {
+			// strtoull would wrap negative numbers around
+			cond.int_value = strtoull(value.c_str(), &end, 10);
+			if (value.find('-') != string::npos) {
+				throw runtime_error("Invalid unsigned integer " + value);
+			}
+		} else {
+			cond.int_value = strtoll(value.c_str(), &end, 10);
+		}
+		if (value.empty() || *end || errno) {
+			throw runtime_error("Invalid integer " + value);
+		}
+		break;
+	case parquet::format::Type::FLOAT:
+	case parquet::format::Type::DOUBLE:
+		cond.double_value = strtod(value.c_str(), &end);
+		if (value.empty() || *end) {
+			throw runtime_error("Invalid number " + value);
+		}
+		break;
+	case parquet::format::Type::BYTE_ARRAY:
+		cond.string_value = value;
+		// decimals are ordered as signed numbers
+		if (s_ele.__isset.converted_type
+				&& s_ele.converted_type
+						== parquet::format::ConvertedType::DECIMAL) {
+			cond.use_statistics = false;
+		}
+		break;
+	default:
+		throw runtime_error("Cannot filter on column " + cond.column);
+	}
+	return cond;
+}
+
+// compares a PLAIN encoded value of the column with the value of cond
+static int compare(const Condition &cond, const char *value, size_t len) {
+	switch (cond.type) {
+	case parquet::format::Type::BOOLEAN:
+		return three_way<int64_t>(*(uint8_t*) value != 0, cond.int_value);
+	case parquet::format::Type::INT32: {
+		int32_t val;
+		memcpy(&val, value, sizeof(val));
+		if (cond.is_unsigned) {
+			return three_way<uint64_t>((uint32_t) val, cond.int_value);
+		}
+		return three_way<int64_t>(val, cond.int_value);
+	}
+	case parquet::format::Type::INT64: {
+		int64_t val;
+		memcpy(&val, value, sizeof(val));
+		if (cond.is_unsigned) {
+			return three_way<uint64_t>(val, cond.int_value);
+		}
+		return three_way<int64_t>(val, cond.int_value);
+	}
+	case parquet::format::Type::FLOAT:
+	case parquet::format::Type::DOUBLE: {
+		double val;
+		if (cond.type == parquet::format::Type::FLOAT) {
+			float float_val;
+			memcpy(&float_val, value, sizeof(float_val));
+			val = float_val;
+		} else {
+			memcpy(&val, value, sizeof(val));
+		}
+		if (std::isnan(val) || std::isnan(cond.double_value)) {
+			return UNORDERED;
+		}
+		return three_way(val, cond.double_value);
+	}
+	case parquet::format::Type::BYTE_ARRAY: {
+		auto res = memcmp(value, cond.string_value.data(),
+				min(len, cond.string_value.size()));
+		return res != 0 ?
+				(res < 0 ? -1 : 1) :
+				three_way(len, cond.string_value.size());
+	}
+	default:
+		throw runtime_error("Cannot filter on column " + cond.column);
+	}
+}
+
+static bool holds(Op op, int cmp) {
+	if (cmp == UNORDERED) {
+		return op == Op::NE;
+	}
+	switch (op) {
+	case Op::EQ:
+		return cmp == 0;
+	case Op::NE:
+		return cmp != 0;
+	case Op::LT:
+		return cmp < 0;
+	case Op::LE:
+		return cmp <= 0;
+	case Op::GT:
+		return cmp > 0;
+	case Op::GE:
+		return cmp >= 0;
+	}
+	return false;
+}
+
+static size_t value_size(parquet::format::Type::type type) {
+	switch (type) {
+	case parquet::format::Type::BOOLEAN:
+		return 1;
+	case parquet::format::Type::INT32:
+	case parquet::format::Type::FLOAT:
+		return 4;
+	case parquet::format::Type::INT64:
+	case parquet::format::Type::DOUBLE:
+		return 8;
+	default:
+		return 0;
+	}
+}
+
+// false if the statistics of a row group rule out any match of cond
+static bool may_match(ParquetFile &f, uint64_t row_group_idx,
+		const Condition &cond) {
+	string min_bytes, max_bytes;
+	if (!cond.use_statistics
+			|| !f.chunk_min_max(row_group_idx, cond.col_idx, min_bytes,
+					max_bytes)) {
+		return true;
+	}
+	auto size = value_size(cond.type);
+	if (size > 0 && (min_bytes.size() != size || max_bytes.size() != size)) {
+		return true;
+	}
+	// only min_value and max_value are in unsigned order, the deprecated min and max are signed
+	auto &chunk = f.meta_data().row_groups[row_group_idx].columns[cond.col_idx];
+	if (cond.is_unsigned && !chunk.meta_data.statistics.__isset.min_value) {
+		return true;
+	}
+	auto cmp_min = compare(cond, min_bytes.data(), min_bytes.size());
+	auto cmp_max = compare(cond, max_bytes.data(), max_bytes.size());
+	if (cmp_min == UNORDERED || cmp_max == UNORDERED) {
+		return true;
+	}
+	switch (cond.op) {
+	case Op::EQ:
+		return cmp_min <= 0 && cmp_max >= 0;
+	case Op::NE:
+		return !(cmp_min == 0 && cmp_max == 0);
+	case Op::LT:
+		return cmp_min < 0;
+	case Op::LE:
+		return cmp_min <= 0;
+	case Op::GT:
+		return cmp_max > 0;
+	case Op::GE:
+		return cmp_max >= 0;
+	}
+	return true;
+}
+
+static bool matches(const ResultChunk &rc, const vector<Condition> &conditions,
+		uint64_t row) {
+	for (auto &cond : conditions) {
+		auto &col = rc.cols[cond.result_idx];
+		if (!((uint8_t*) col.defined.ptr)[row]) {
+			return false;
+		}
+		int cmp;
+		if (cond.type == parquet::format::Type::BYTE_ARRAY) {
+			auto str = ((char**) col.data.ptr)[row];
+			cmp = compare(cond, str, strlen(str));
+		} else {
+			auto size = value_size(cond.type);
+			cmp = compare(cond, col.data.ptr + row * size, size);
+		}
+		if (!holds(cond.op, cmp)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// the rows of the chunk to write, this uses up offset and limit
+static void select_rows(const ResultChunk &rc,
+		const vector<Condition> &conditions, Options &options,
+		vector<uint64_t> &rows) {
+	rows.clear();
+	for (uint64_t row = 0; row < rc.nrows && options.limit > 0; row++) {
+		if (!matches(rc, conditions, row)) {
+			continue;
+		}
+		if (options.offset > 0) {
+			options.offset--;
+			continue;
+		}
+		rows.push_back(row);
+		options.limit--;
+	}
+}
+
+static void format_rows(const ResultChunk &rc,
+		const vector<format_fn> &formatters, const uint64_t *rows,
+		uint64_t count, const Options &options, OutputBuffer &out) {
+	for (uint64_t i = 0; i < count; i++) {
+		auto row = rows[i];
+		for (size_t col_idx = 0; col_idx < formatters.size(); col_idx++) {
+			if (col_idx > 0) {
+				out.append(options.delimiter.data(), options.delimiter.size());
+			}
+			auto &col = rc.cols[col_idx];
+			if (!((uint8_t*) col.defined.ptr)[row]) {
+				out.append(options.null_value.data(),
+						options.null_value.size());
+				continue;
+			}
+			if (!formatters[col_idx]) {
+				format_string(((char**) col.data.ptr)[row], options.delimiter,
+						out);
+				continue;
+			}
+			formatters[col_idx](col, row, out);
+		}
+		out.append("\n", 1);
+	}
+}
+
+// formats slices of the selected rows on up to one thread per buffer and writes them in order
+static void write_chunk(const ResultChunk &rc,
+		const vector<format_fn> &formatters, const vector<uint64_t> &rows,
+		const Options &options, vector<OutputBuffer> &buffers) {
+	uint64_t slices = (rows.size() + SLICE_ROWS - 1) / SLICE_ROWS;
+	atomic<uint64_t> next_slice(0);
+	uint64_t next_write = 0;
+	bool failed = false;
+	exception_ptr error;
+	mutex lock;
+	condition_variable written;
+
+	auto worker = [&](OutputBuffer &out) {
+		try {
+			uint64_t slice;
+			while ((slice = next_slice++) < slices) {
+				out.len = 0;
+				auto begin = slice * SLICE_ROWS;
+				format_rows(rc, formatters, rows.data() + begin,
+						min<uint64_t>(rows.size() - begin, SLICE_ROWS), options,
+						out);
+				unique_lock<mutex> guard(lock);
+				written.wait(guard, [&] {
+					return next_write == slice || failed;
+				});
+				if (failed) {
+					return;
+				}
+				write_all(STDOUT_FILENO, out.data.data(), out.len);
+				next_write++;
+				written.notify_all();
+			}
+		} catch (...) {
+			lock_guard<mutex> guard(lock);
+			if (!failed) {
+				failed = true;
+				error = current_exception();
+			}
+			next_slice = slices;
+			written.notify_all();
+		}
+	};
+
+	vector<thread> pool;
+	for (uint64_t i = 1; i < min<uint64_t>(buffers.size(), slices); i++) {
+		pool.push_back(thread(worker, ref(buffers[i])));
+	}
+	worker(buffers[0]);
+	for (auto &t : pool) {
+		t.join();
+	}
+	if (error) {
+		rethrow_exception(error);
+	}
+}
+
+static void write_file(const char *fname, Options &options) {
+	auto f = ParquetFile(fname);
+
+	// the output columns, followed by the ones only needed for conditions
+	vector<uint64_t> column_ids;
+	for (auto &name : options.columns) {
+		auto col_idx = f.columns.size();
+		for (uint64_t i = 0; i < f.columns.size(); i++) {
+			if (f.columns[i]->name == name) {
+				col_idx = i;
+			}
+		}
+		if (col_idx == f.columns.size()) {
+			throw runtime_error("No column " + name);
+		}
+		column_ids.push_back(col_idx);
+	}
+	if (options.columns.empty()) {
+		for (uint64_t col_idx = 0; col_idx < f.columns.size(); col_idx++) {
+			column_ids.push_back(col_idx);
+		}
+	}
+	vector<format_fn> formatters;
+	for (auto col_idx : column_ids) {
+		formatters.push_back(column_formatter(*f.columns[col_idx]));
+	}
+	vector<Condition> conditions;
+	for (auto &text : options.where) {
+		auto cond = parse_condition(text, f);
+		cond.result_idx = find(column_ids.begin(), column_ids.end(),
+				cond.col_idx) - column_ids.begin();
+		if (cond.result_idx == column_ids.size()) {
+			column_ids.push_back(cond.col_idx);
+		}
+		conditions.push_back(cond);
+	}
+
+	// row groups that can have rows to write. Without conditions, offset and limit are applied to
+	// whole row groups from the metadata already.
+	vector<uint64_t> row_groups;
+	auto &meta_data = f.meta_data();
+	uint64_t planned_rows = 0;
+	for (uint64_t rg = 0; rg < meta_data.row_groups.size(); rg++) {
+		if (conditions.empty()) {
+			uint64_t num_rows = meta_data.row_groups[rg].num_rows;
+			if (planned_rows == 0 && options.offset >= num_rows) {
+				options.offset -= num_rows;
+				continue;
+			}
+			if (planned_rows > options.offset
+					&& planned_rows - options.offset >= options.limit) {
+				break;
+			}
+			planned_rows += num_rows;
+			row_groups.push_back(rg);
+			continue;
+		}
+		bool match = true;
+		for (auto &cond : conditions) {
+			match = match && may_match(f, rg, cond);
+		}
+		if (match) {
+			row_groups.push_back(rg);
+		}
+	}
+	if (row_groups.empty() || options.limit == 0) {
+		return;
+	}
+
+	auto threads = max(options.threads, 1u);
+	vector<OutputBuffer> buffers(threads);
+	vector<uint64_t> rows;
+	size_t next_row_group = 0;
+	auto scan_next = [&](ResultChunk &rc) {
+		ScanState s;
+		s.row_group_idx = row_groups[next_row_group++];
+		f.scan(s, rc);
+	};
+
+	// the next row group is decoded while the current one is formatted
+	ResultChunk chunks[2];
+	f.initialize_result(chunks[0], column_ids);
+	f.initialize_result(chunks[1], column_ids);
+	auto current = 0;
+	scan_next(chunks[current]);
+	while (true) {
+		select_rows(chunks[current], conditions, options, rows);
+		bool more = options.limit > 0 && next_row_group < row_groups.size();
+		auto &next = chunks[1 - current];
+		exception_ptr decode_error;
+		auto decode = [&]() {
+			try {
+				scan_next(next);
+			} catch (...) {
+				decode_error = current_exception();
+			}
+		};
+		if (more && threads > 1) {
+			thread decoder(decode);
+			try {
+				write_chunk(chunks[current], formatters, rows, options,
+						buffers);
+			} catch (...) {
+				decoder.join();
+				throw;
+			}
+			decoder.join();
+		} else {
+			write_chunk(chunks[current], formatters, rows, options, buffers);
+			if (more) {
+				decode();
+			}
+		}
+		if (decode_error) {
+			rethrow_exception(decode_error);
+		}
+		if (!more) {
+			break;
+		}
+		current = 1 - current;
+	}
+}
+
+static void usage(const char *name) {
+	fprintf(stderr,
+			"Usage: %s [options] [file.parquet ...]\n"
+					"Writes Parquet files as delimited text, standard input if no file is given.\n"
+					"  --columns a,b,c   only these columns, in this order\n"
+					"  --where 'a >= 1'  only rows where a column compares to a value with =, !=, <,\n"
+					"                    <=, > or >=, can be repeated\n"
+					"  --offset n        skip the first n rows\n"
+					"  --limit n         write at most n rows\n"
+					"  --threads n       formatting threads, all cores by default\n"
+					"  --delimiter s     between values, a tab by default, \\t also works\n"
+					"  --null s          for NULL values, NULL by default\n"
+					"Strings with the delimiter, a quote or a line break are quoted like in CSV.\n",
+			name);
+	exit(2);
+}
+
+static uint64_t parse_count(const char *name, const string &value) {
+	char *end;
+	errno = 0;
+	auto res = strtoull(value.c_str(), &end, 10);
+	if (value.empty() || *end || errno || value[0] == '-') {
+		fprintf(stderr, "Invalid number for %s: %s\n", name, value.c_str());
+		exit(2);
+	}
+	return res;
+}
+
+int main(int argc, char *const argv[]) {
+	Options options;
+	vector<const char*> files;
+
+	for (int arg = 1; arg < argc; arg++) {
+		string name = argv[arg];
+		if (name.size() <= 2 || name.compare(0, 2, "--") != 0) {
+			files.push_back(argv[arg]);
+			continue;
+		}
+		// --name value or --name=value
+		string value;
+		auto eq = name.find('=');
+		if (eq != string::npos) {
+			value = name.substr(eq + 1);
+			name.resize(eq);
+		} else if (arg + 1 < argc) {
+			value = argv[++arg];
+		} else {
+			usage(argv[0]);
+		}
+		if (name == "--columns") {
+			size_t start = 0, comma;
+			do {
+				comma = value.find(',', start);
+				options.columns.push_back(
+						trim(value.substr(start, comma - start)));
+				start = comma + 1;
+			} while (comma != string::npos);
+		} else if (name == "--where") {
+			options.where.push_back(value);
+		} else if (name == "--offset") {
+			options.offset = parse_count("--offset", value);
+		} else if (name == "--limit") {
+			options.limit = parse_count("--limit", value);
+		} else if (name == "--threads") {
+			options.threads = parse_count("--threads", value);
+		} else if (name == "--delimiter") {
+			options.delimiter = value == "\\t" ? "\t" : value;
+		} else if (name == "--null") {
+			options.null_value = value;
+		} else {
+			usage(argv[0]);
+		}
+	}
+	// no files: read from stdin, e.g. pq2csv < file.parquet
+	if (files.empty()) {
+		files.push_back("-");
+	}
+
+	for (auto fname : files) {
+		try {
+			write_file(fname, options);
+		} catch (std::exception &e) {
+			fprintf(stderr, "%s: %s\n", fname, e.what());
+			return 1;
+		}
+		if (options.limit == 0) {
+			break;
+		}
+	}
+	return 0;
 }
@@ -0,0 +1,154 @@
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+
+#include "miniparquet.h"
+
+using namespace miniparquet;
+using namespace std;
+
+// verifies Parquet files by fully decoding every column chunk with checksum verification on,
+// spreading the chunks over all cores
+
+struct ChunkTask {
+	uint64_t row_group_idx;
+	uint64_t col_idx;
+	uint64_t compressed_bytes;
+	double seconds = 0;
+	string error;
+};
+
+static double now() {
+	return chrono::duration<double>(
+			chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool check_file(const char *fname, unsigned threads, bool verbose) {
+	auto start = now();
+	unique_ptr<ParquetFile> f;
+	try {
+		f = unique_ptr<ParquetFile>(new ParquetFile(fname));
+	} catch (std::exception &e) {
+		printf("%s: FAILED: %s\n", fname, e.what());
+		return false;
+	}
+
+	// one task per column chunk, in file order
+	auto &meta_data = f->meta_data();
+	vector<ChunkTask> tasks;
+	for (uint64_t rg = 0; rg < meta_data.row_groups.size(); rg++) {
+		auto &row_group = meta_data.row_groups[rg];
+		if (row_group.columns.size() != f->columns.size()) {
+			printf("%s: FAILED: Row group %llu has %llu columns, schema has %llu\n",
+					fname, (unsigned long long) rg,
+					(unsigned long long) row_group.columns.size(),
+					(unsigned long long) f->columns.size());
+			return false;
+		}
+		for (uint64_t col = 0; col < f->columns.size(); col++) {
+			ChunkTask task;
+			task.row_group_idx = rg;
+			task.col_idx = col;
+			task.compressed_bytes =
+					row_group.columns[col].meta_data.total_compressed_size;
+			tasks.push_back(task);
+		}
+	}
+
+	atomic<size_t> next_task(0);
+	atomic<bool> failed(false);
+	auto worker = [&]() {
+		ResultChunk rc;
+		size_t task_idx;
+		while (!failed && (task_idx = next_task++) < tasks.size()) {
+			auto &task = tasks[task_idx];
+			auto task_start = now();
+			try {
+				f->initialize_result(rc, { task.col_idx });
+				ScanState s;
+				s.row_group_idx = task.row_group_idx;
+				s.verify_crc = true;
+				f->scan(s, rc);
+			} catch (std::exception &e) {
+				task.error = e.what();
+				failed = true;
+			}
+			task.seconds = now() - task_start;
+		}
+	};
+
+	vector<thread> pool;
+	for (unsigned i = 1; i < threads; i++) {
+		pool.push_back(thread(worker));
+	}
+	worker();
+	for (auto &t : pool) {
+		t.join();
+	}
+	auto seconds = now() - start;
+
+	// tasks are in file order, so the first one with an error is the first failure in the file
+	for (auto &task : tasks) {
+		if (!task.error.empty()) {
+			printf("%s: FAILED: %s\n", fname, task.error.c_str());
+			return false;
+		}
+	}
+
+	uint64_t total_bytes = 0;
+	for (auto &task : tasks) {
+		total_bytes += task.compressed_bytes;
+	}
+	printf("%s: OK, %llu rows, %llu columns, %llu row groups, %.1f MB in %.3f s (%.1f MB/s)\n",
+			fname, (unsigned long long) f->nrow,
+			(unsigned long long) f->columns.size(),
+			(unsigned long long) meta_data.row_groups.size(),
+			total_bytes / 1000000.0, seconds,
+			total_bytes / 1000000.0 / seconds);
+
+	if (verbose) {
+		// throughput per column is measured in thread time, so it is independent of the thread count
+		for (uint64_t col = 0; col < f->columns.size(); col++) {
+			uint64_t col_bytes = 0;
+			double col_seconds = 0;
+			for (auto &task : tasks) {
+				if (task.col_idx == col) {
+					col_bytes += task.compressed_bytes;
+					col_seconds += task.seconds;
+				}
+			}
+			printf("  %-30s %10.1f MB %10.1f MB/s\n",
+					f->columns[col]->name.c_str(), col_bytes / 1000000.0,
+					col_seconds > 0 ? col_bytes / 1000000.0 / col_seconds : 0);
+		}
+	}
+	return true;
+}
+
+int main(int argc, char *const argv[]) {
+	unsigned threads = thread::hardware_concurrency();
+	bool verbose = false;
+	bool all_ok = true;
+	int files = 0;
+
+	for (int arg = 1; arg < argc; arg++) {
+		if (strcmp(argv[arg], "-t") == 0 && arg + 1 < argc) {
+			threads = atoi(argv[++arg]);
+			continue;
+		}
+		if (strcmp(argv[arg], "-v") == 0) {
+			verbose = true;
+			continue;
+		}
+		all_ok &= check_file(argv[arg], max(threads, 1u), verbose);
+		files++;
+	}
+	if (files == 0) {
+		fprintf(stderr, "Usage: %s [-t threads] [-v] file.parquet ...\n", argv[0]);
+		return 2;
+	}
+	return all_ok ? 0 : 1;
+}
@@ -2,17 +2,21 @@
 # -*- coding: utf-8 -*-
 
 from distutils.core import setup, Extension
+from distutils.command.build_ext import build_ext
 import os
 import platform
+import numpy
 
-ignored_files = ['rwrapper.cpp']
+ignored_files = ['rwrapper.cpp', 'cwrapper.cpp']
 extensions = ['.cpp', '.cc']
-include_paths = ['src', 'src/thrift']
+include_paths = ['src', 'src/thrift', numpy.get_include()]
 toolchain_args = ['-std=c++11']
+if platform.system() != 'Windows':
+    toolchain_args.append('-pthread')
 if platform.system() == 'Darwin':
     toolchain_args.extend(['-stdlib=libc++', '-mmacosx-version-min=10.7'])
 
-def get_files(dirname):
+def get_files(dirname, extensions=extensions):
 	file_list = os.listdir(dirname)
 	result = []
 	for fname in file_list:
@@ -20,12 +24,23 @@ def get_files(dirname):
 			continue
 		full_name = os.path.join(dirname, fname)
 		if os.path.isdir(full_name):
-			result += get_files(full_name)
+			result += get_files(full_name, extensions)
 		else:
-			if full_name.endswith('.cpp') or full_name.endswith('.cc'):
+			if os.path.splitext(full_name)[1] in extensions:
 				result.append(full_name)
 	return result
 
+# the vendored zstd decompressor is C, it is built as a static library so it does not get the C++ flags
+libzstd = ('zstd', {
+	'sources': get_files('src/zstd', ['.c']),
+	'macros': [('ZSTD_DISABLE_ASM', None)]})
+
+# build_ext on its own, e.g. with --inplace, does not build the libraries it links against
+class build_ext_with_libraries(build_ext):
+	def run(self):
+		self.run_command('build_clib')
+		build_ext.run(self)
+
 libminiparquet = Extension('miniparquet',
                     sources = get_files('src'),
 					include_dirs = include_paths,
@@ -39,4 +54,6 @@ setup (name = 'miniparquet',
 	   install_requires=[ # these versions are still available for Python 2, newer ones aren't
 			'numpy>=1.14'
 		],
+       libraries = [libzstd],
+       cmdclass = {'build_ext': build_ext_with_libraries},
        ext_modules = [libminiparquet])
@@ -0,0 +1,412 @@
+#include <string>
+#include <stdexcept>
+#include <cerrno>
+#include <climits>
+
+#include "miniparquet.h"
+#include "arrow/abi.h"
+#include "simd/simd.h"
+
+using namespace std;
+using namespace miniparquet;
+using namespace parquet::format;
+
+// surely they are joking
+constexpr int64_t kJulianToUnixEpochDays = 2440588LL;
+constexpr int64_t kMillisecondsInADay = 86400000LL;
+constexpr int64_t kNanosecondsInADay = kMillisecondsInADay * 1000LL * 1000LL;
+
+static int64_t impala_timestamp_to_nanoseconds(const Int96 &impala_timestamp) {
+	int64_t days_since_epoch = impala_timestamp.value[2]
+			- kJulianToUnixEpochDays;
+
+	int64_t nanoseconds;
+	memcpy(&nanoseconds, impala_timestamp.value, sizeof(nanoseconds));
+	return days_since_epoch * kNanosecondsInADay + nanoseconds;
+}
+
+static bool is_decimal(const SchemaElement &s_ele) {
+	return (s_ele.__isset.converted_type
+			&& s_ele.converted_type == ConvertedType::DECIMAL)
+			|| (s_ele.__isset.logicalType && s_ele.logicalType.__isset.DECIMAL);
+}
+
+// the Arrow format string of a column, see the C data interface spec
+static string arrow_format(const ParquetColumn &col) {
+	auto &s_ele = *col.schema_element;
+	auto converted = s_ele.__isset.converted_type ?
+			s_ele.converted_type : (ConvertedType::type) -1;
+	switch (col.type) {
+	case Type::BOOLEAN:
+		return "b";
+	case Type::INT32:
+		switch (converted) {
+		case ConvertedType::DATE:
+			return "tdD";
+		case ConvertedType::TIME_MILLIS:
+			return "ttm";
+		case ConvertedType::UINT_32:
+			return "I";
+		default:
+			return "i";
+		}
+	case Type::INT64:
+		if (s_ele.__isset.logicalType && s_ele.logicalType.__isset.TIMESTAMP) {
+			auto &ts = s_ele.logicalType.TIMESTAMP;
+			string tz = ts.isAdjustedToUTC ? "UTC" : "";
+			if (ts.unit.__isset.MILLIS) {
+				return "tsm:" + tz;
+			}
+			if (ts.unit.__isset.NANOS) {
+				return "tsn:" + tz;
+			}
+			return "tsu:" + tz;
+		}
+		switch (converted) {
+		case ConvertedType::TIMESTAMP_MILLIS:
+			return "tsm:UTC";
+		case ConvertedType::TIMESTAMP_MICROS:
+			return "tsu:UTC";
+		case ConvertedType::TIME_MICROS:
+			return "ttu";
+		case ConvertedType::UINT_64:
+			return "L";
+		default:
+			return "l";
+		}
+	case Type::INT96:
+		return "tsn:";
+	case Type::FLOAT:
+		return "f";
+	case Type::DOUBLE:
+		return "g";
+	case Type::FIXED_LEN_BYTE_ARRAY:
+		if (is_decimal(s_ele) && s_ele.type_length <= 16) {
+			auto precision = s_ele.__isset.precision ?
+					s_ele.precision : s_ele.logicalType.DECIMAL.precision;
+			auto scale = s_ele.__isset.scale ?
+					s_ele.scale : s_ele.logicalType.DECIMAL.scale;
+			return "d:" + to_string(precision) + "," + to_string(scale);
+		}
+		return "w:" + to_string(s_ele.type_length);
+	case Type::BYTE_ARRAY:
+		if (converted == ConvertedType::UTF8 || converted == ConvertedType::JSON
+				|| converted == ConvertedType::ENUM
+				|| (s_ele.__isset.logicalType
+						&& s_ele.logicalType.__isset.STRING)) {
+			return "u";
+		}
+		return "z";
+	default:
+		throw runtime_error("Unsupported type " + to_string(col.type));
+	}
+}
+
+// owns everything an exported schema points to
+struct SchemaData {
+	string format;
+	string name;
+	vector<ArrowSchema> children;
+	vector<ArrowSchema*> child_ptrs;
+
+	// consumers may have moved children out, those have no release callback anymore
+	~SchemaData() {
+		for (auto &child : children) {
+			if (child.release) {
+				child.release(&child);
+			}
+		}
+	}
+};
+
+static void release_schema(ArrowSchema *schema) {
+	delete (SchemaData*) schema->private_data;
+	schema->release = nullptr;
+}
+
+static void init_schema(ArrowSchema *out, SchemaData *data, int64_t flags) {
+	out->format = data->format.c_str();
+	out->name = data->name.c_str();
+	out->metadata = nullptr;
+	out->flags = flags;
+	out->n_children = data->children.size();
+	out->children = data->child_ptrs.empty() ? nullptr : data->child_ptrs.data();
+	out->dictionary = nullptr;
+	out->release = release_schema;
+	out->private_data = data;
+}
+
+void miniparquet::export_arrow_schema(const ResultChunk &result,
+		ArrowSchema *out) {
+	unique_ptr<SchemaData> data(new SchemaData());
+	data->format = "+s";
+	data->children.resize(result.cols.size());
+	for (auto &child : data->children) {
+		child.release = nullptr;
+	}
+	for (size_t i = 0; i < result.cols.size(); i++) {
+		auto &col = *result.cols[i].col;
+		unique_ptr<SchemaData> child_data(new SchemaData());
+		child_data->format = arrow_format(col);
+		child_data->name = col.name;
+		auto required = col.schema_element->__isset.repetition_type
+				&& col.schema_element->repetition_type
+						== FieldRepetitionType::REQUIRED;
+		init_schema(&data->children[i], child_data.release(),
+				required ? 0 : ARROW_FLAG_NULLABLE);
+		data->child_ptrs.push_back(&data->children[i]);
+	}
+	init_schema(out, data.release(), 0);
+}
+
+// owns everything an exported array points to
+struct ArrayData {
+	vector<ByteBuffer> buffers;
+	const void *buffer_ptrs[3] = { nullptr, nullptr, nullptr };
+	vector<ArrowArray> children;
+	vector<ArrowArray*> child_ptrs;
+
+	~ArrayData() {
+		for (auto &child : children) {
+			if (child.release) {
+				child.release(&child);
+			}
+		}
+	}
+};
+
+static void release_array(ArrowArray *array) {
+	delete (ArrayData*) array->private_data;
+	array->release = nullptr;
+}
+
+// packs one byte per row into a bitmap with a set bit for every non-zero byte
+static void pack_bitmap(const char *bytes, uint64_t n, ByteBuffer &bitmap) {
+	bitmap.resize(max<uint64_t>((n + 7) / 8, 1), false);
+	auto dst = (uint8_t*) bitmap.ptr;
+	uint64_t row = 0;
+	for (; row + 8 <= n; row += 8) {
+		uint8_t bits = 0;
+		for (int bit = 0; bit < 8; bit++) {
+			bits |= (bytes[row + bit] != 0) << bit;
+		}
+		dst[row / 8] = bits;
+	}
+	if (row < n) {
+		uint8_t bits = 0;
+		for (int bit = 0; row + bit < n; bit++) {
+			bits |= (bytes[row + bit] != 0) << bit;
+		}
+		dst[row / 8] = bits;
+	}
+}
+
+static void export_column(ResultColumn &col, uint64_t nrows, ArrowArray *out) {
+	unique_ptr<ArrayData> data(new ArrayData());
+	auto defined = col.defined.ptr;
+	auto null_count = simd::kernels().count_zeros((const uint8_t*) defined,
+			nrows);
+	auto &s_ele = *col.col->schema_element;
+
+	ByteBuffer validity;
+	if (null_count > 0) {
+		pack_bitmap(defined, nrows, validity);
+	}
+	ByteBuffer values, offsets;
+
+	switch (col.col->type) {
+	case Type::BOOLEAN:
+		pack_bitmap(col.data.ptr, nrows, values);
+		break;
+	case Type::INT32:
+	case Type::INT64:
+	case Type::FLOAT:
+	case Type::DOUBLE:
+		// same layout, hand over as is
+		values = move(col.data);
+		break;
+	case Type::INT96: {
+		values.resize(max<uint64_t>(nrows * sizeof(int64_t), 1), false);
+		auto src = (Int96*) col.data.ptr;
+		auto dst = (int64_t*) values.ptr;
+		for (uint64_t row = 0; row < nrows; row++) {
+			dst[row] = defined[row] ? impala_timestamp_to_nanoseconds(src[row]) : 0;
+		}
+		break;
+	}
+	case Type::FIXED_LEN_BYTE_ARRAY: {
+		auto type_len = (uint64_t) s_ele.type_length;
+		auto src = (char**) col.data.ptr;
+		if (is_decimal(s_ele) && type_len <= 16) {
+			// big endian two's complement to 128 bit little endian
+			values.resize(max<uint64_t>(nrows * 16, 1), false);
+			memset(values.ptr, 0, nrows * 16);
+			for (uint64_t row = 0; row < nrows; row++) {
+				if (!defined[row] || type_len == 0) {
+					continue;
+				}
+				auto dst = (uint8_t*) values.ptr + row * 16;
+				auto val = (const uint8_t*) src[row];
+				memset(dst, (val[0] & 0x80) ? 0xFF : 0, 16);
+				for (uint64_t byte = 0; byte < type_len; byte++) {
+					dst[byte] = val[type_len - 1 - byte];
+				}
+			}
+		} else {
+			values.resize(max<uint64_t>(nrows * type_len, 1), false);
+			memset(values.ptr, 0, nrows * type_len);
+			for (uint64_t row = 0; row < nrows; row++) {
+				if (defined[row]) {
+					memcpy(values.ptr + row * type_len, src[row], type_len);
+				}
+			}
+		}
+		break;
+	}
+	case Type::BYTE_ARRAY: {
+		// strings are scattered over the heap chunks, gather them into one buffer with offsets.
+		// Rows that share a dictionary entry also share its length.
+		auto src = (char**) col.data.ptr;
+		auto dict_indices = (uint32_t*) col.dict_indices.ptr;
+		vector<uint32_t> dict_lens(col.dictionary.size());
+		for (size_t i = 0; i < col.dictionary.size(); i++) {
+			dict_lens[i] = strlen(col.dictionary[i]);
+		}
+		offsets.resize((nrows + 1) * sizeof(int32_t), false);
+		auto offs = (int32_t*) offsets.ptr;
+		uint64_t total_len = 0;
+		offs[0] = 0;
+		for (uint64_t row = 0; row < nrows; row++) {
+			if (defined[row]) {
+				auto dict_idx = dict_indices[row];
+				total_len += dict_idx != ResultColumn::NO_DICT_INDEX ?
+						dict_lens[dict_idx] : strlen(src[row]);
+				if (total_len > INT32_MAX) {
+					throw runtime_error(
+							"Column " + col.col->name
+									+ " has too much string data for an Arrow string array");
+				}
+			}
+			offs[row + 1] = total_len;
+		}
+		values.resize(max<uint64_t>(total_len, 1), false);
+		for (uint64_t row = 0; row < nrows; row++) {
+			if (defined[row]) {
+				memcpy(values.ptr + offs[row], src[row], offs[row + 1] - offs[row]);
+			}
+		}
+		break;
+	}
+	default:
+		throw runtime_error("Unsupported type " + to_string(col.col->type));
+	}
+
+	// consumers want data buffers even for empty arrays
+	if (!values.ptr) {
+		values.resize(1);
+	}
+	data->buffer_ptrs[0] = validity.ptr;
+	out->n_buffers = 2;
+	if (offsets.ptr) {
+		data->buffer_ptrs[1] = offsets.ptr;
+		data->buffer_ptrs[2] = values.ptr;
+		out->n_buffers = 3;
+	} else {
+		data->buffer_ptrs[1] = values.ptr;
+	}
+	data->buffers.push_back(move(validity));
+	data->buffers.push_back(move(offsets));
+	data->buffers.push_back(move(values));
+
+	out->length = nrows;
+	out->null_count = null_count;
+	out->offset = 0;
+	out->n_children = 0;
+	out->buffers = data->buffer_ptrs;
+	out->children = nullptr;
+	out->dictionary = nullptr;
+	out->release = release_array;
+	out->private_data = data.release();
+}
+
+void miniparquet::export_arrow_array(ResultChunk &result, ArrowArray *out) {
+	unique_ptr<ArrayData> data(new ArrayData());
+	data->children.resize(result.cols.size());
+	for (auto &child : data->children) {
+		child.release = nullptr;
+	}
+	// on errors, data releases the columns exported so far
+	for (size_t i = 0; i < result.cols.size(); i++) {
+		export_column(result.cols[i], result.nrows, &data->children[i]);
+		data->child_ptrs.push_back(&data->children[i]);
+	}
+	out->length = result.nrows;
+	out->null_count = 0;
+	out->offset = 0;
+	out->n_buffers = 1;
+	out->n_children = data->children.size();
+	out->buffers = data->buffer_ptrs;
+	out->children = data->child_ptrs.empty() ? nullptr : data->child_ptrs.data();
+	out->dictionary = nullptr;
+	out->release = release_array;
+	out->private_data = data.release();
+}
+
+// state of an exported stream
+struct StreamData {
+	shared_ptr<ParquetFile> file;
+	ScanState state;
+	ResultChunk result;
+	string last_error;
+};
+
+static int stream_get_schema(ArrowArrayStream *stream, ArrowSchema *out) {
+	auto data = (StreamData*) stream->private_data;
+	try {
+		export_arrow_schema(data->result, out);
+	} catch (std::exception &e) {
+		data->last_error = e.what();
+		return EINVAL;
+	}
+	return 0;
+}
+
+static int stream_get_next(ArrowArrayStream *stream, ArrowArray *out) {
+	auto data = (StreamData*) stream->private_data;
+	try {
+		if (!data->file->scan(data->state, data->result)) {
+			// end of stream
+			out->release = nullptr;
+			return 0;
+		}
+		export_arrow_array(data->result, out);
+	} catch (std::exception &e) {
+		data->last_error = e.what();
+		return EIO;
+	}
+	return 0;
+}
+
+static const char* stream_get_last_error(ArrowArrayStream *stream) {
+	auto data = (StreamData*) stream->private_data;
+	return data->last_error.empty() ? nullptr : data->last_error.c_str();
+}
+
+static void release_stream(ArrowArrayStream *stream) {
+	delete (StreamData*) stream->private_data;
+	stream->release = nullptr;
+}
+
+void miniparquet::export_arrow_stream(std::shared_ptr<ParquetFile> file,
+		std::vector<uint64_t> column_ids, ArrowArrayStream *out) {
+	unique_ptr<StreamData> data(new StreamData());
+	file->initialize_result(data->result, column_ids);
+	data->file = move(file);
+	data->state.readahead = true;
+
+	out->get_schema = stream_get_schema;
+	out->get_next = stream_get_next;
+	out->get_last_error = stream_get_last_error;
+	out->release = release_stream;
+	out->private_data = data.release();
+}
@@ -0,0 +1,198 @@
+#include <map>
+#include <atomic>
+#include <stdexcept>
+
+#include "miniparquet.h"
+#include "snappy/snappy.h"
+#include "snappy/snappy-ssse3-bmi2.h"
+#include "deflate/inflate.h"
+#include "zstd/zstd.h"
+#include "lz4/lz4.h"
+#include "simd/simd.h"
+
+using namespace std;
+using namespace miniparquet;
+using namespace parquet::format;
+
+namespace {
+
+typedef bool (*snappy_uncompress_t)(const char*, size_t, char*);
+
+// distributed binaries are built for the baseline CPU, use the build with the fast paths if we can
+static snappy_uncompress_t pick_snappy_uncompress() {
+#ifdef MINIPARQUET_HAVE_SNAPPY_SSSE3_BMI2
+	// the AVX2 level implies SSSE3 and BMI2
+	if (simd::level() >= simd::Level::AVX2) {
+		return snappy_ssse3_bmi2::RawUncompress;
+	}
+#endif
+	return snappy::RawUncompress;
+}
+
+class SnappyCodec: public Codec {
+public:
+	SnappyCodec() :
+			uncompress(pick_snappy_uncompress()) {
+	}
+
+	uint64_t uncompressed_length(const char *src, uint64_t src_len,
+			uint64_t expected) override {
+		size_t len;
+		if (!snappy::GetUncompressedLength(src, src_len, &len)) {
+			throw runtime_error("Decompression failure");
+		}
+		return len;
+	}
+
+	void decompress(const char *src, uint64_t src_len, char *dst,
+			uint64_t dst_len) override {
+		// snappy writes as much as the stream says, which has to fit dst
+		size_t len;
+		if (!snappy::GetUncompressedLength(src, src_len, &len)
+				|| len != dst_len || !uncompress(src, src_len, dst)) {
+			throw runtime_error("Decompression failure");
+		}
+	}
+
+private:
+	snappy_uncompress_t uncompress;
+};
+
+class GzipCodec: public Codec {
+public:
+	void decompress(const char *src, uint64_t src_len, char *dst,
+			uint64_t dst_len) override {
+		if (!inflater.uncompress(src, src_len, dst, dst_len)) {
+			throw runtime_error("Decompression failure");
+		}
+	}
+
+private:
+	Inflater inflater;
+};
+
+class ZstdCodec: public Codec {
+public:
+	ZstdCodec() :
+			dctx(ZSTD_createDCtx()) {
+		if (!dctx) {
+			throw runtime_error("Could not create zstd decompression context");
+		}
+	}
+
+	~ZstdCodec() {
+		ZSTD_freeDCtx(dctx);
+	}
+
+	void decompress(const char *src, uint64_t src_len, char *dst,
+			uint64_t dst_len) override {
+		auto res = ZSTD_decompressDCtx(dctx, dst, dst_len, src, src_len);
+		if (ZSTD_isError(res)) {
+			throw runtime_error(
+					string("Decompression failure: ") + ZSTD_getErrorName(res));
+		}
+		if (res != dst_len) {
+			throw runtime_error("Decompressed page size mismatch");
+		}
+	}
+
+private:
+	ZSTD_DCtx *dctx;
+};
+
+class Lz4Codec: public Codec {
+public:
+	Lz4Codec(bool hadoop) :
+			hadoop(hadoop) {
+	}
+
+	void decompress(const char *src, uint64_t src_len, char *dst,
+			uint64_t dst_len) override {
+		auto res =
+				hadoop ?
+						lz4_uncompress_hadoop(src, src_len, dst, dst_len) :
+						lz4_uncompress(src, src_len, dst, dst_len);
+		if (!res) {
+			throw runtime_error("Decompression failure");
+		}
+	}
+
+private:
+	bool hadoop;
+};
+
+struct CodecRegistry {
+	mutex lock;
+	map<int, CodecFactory> factories;
+	// bumped on every registration so threads drop their instances of replaced codecs
+	atomic<uint64_t> generation;
+
+	CodecRegistry() :
+			generation(0) {
+		factories[CompressionCodec::SNAPPY] = []() {
+			return unique_ptr<Codec>(new SnappyCodec());
+		};
+		factories[CompressionCodec::GZIP] = []() {
+			return unique_ptr<Codec>(new GzipCodec());
+		};
+		factories[CompressionCodec::ZSTD] = []() {
+			return unique_ptr<Codec>(new ZstdCodec());
+		};
+		factories[CompressionCodec::LZ4] = []() {
+			return unique_ptr<Codec>(new Lz4Codec(true));
+		};
+		factories[CompressionCodec::LZ4_RAW] = []() {
+			return unique_ptr<Codec>(new Lz4Codec(false));
+		};
+	}
+};
+
+CodecRegistry& registry() {
+	static CodecRegistry registry;
+	return registry;
+}
+
+struct ThreadCodecs {
+	uint64_t generation = 0;
+	map<int, unique_ptr<Codec>> codecs;
+};
+
+thread_local ThreadCodecs thread_codecs;
+
+}
+
+void miniparquet::register_codec(CompressionCodec::type codec,
+		CodecFactory factory) {
+	auto &reg = registry();
+	lock_guard<mutex> guard(reg.lock);
+	reg.factories[codec] = factory;
+	reg.generation++;
+}
+
+Codec* miniparquet::get_codec(CompressionCodec::type codec) {
+	auto &reg = registry();
+	auto &local = thread_codecs;
+	auto generation = reg.generation.load();
+	if (local.generation != generation) {
+		local.codecs.clear();
+		local.generation = generation;
+	}
+	auto it = local.codecs.find(codec);
+	if (it != local.codecs.end()) {
+		return it->second.get();
+	}
+
+	CodecFactory factory;
+	{
+		lock_guard<mutex> guard(reg.lock);
+		auto entry = reg.factories.find(codec);
+		if (entry == reg.factories.end() || !entry->second) {
+			return nullptr;
+		}
+		factory = entry->second;
+	}
+	auto instance = factory();
+	auto res = instance.get();
+	local.codecs[codec] = move(instance);
+	return res;
+}
@@ -0,0 +1,169 @@
+#include "crc32.h"
+#include "simd/simd.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MINIPARQUET_HAVE_PCLMUL 1
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#endif
+
+using namespace miniparquet;
+
+namespace {
+
+// slicing-by-8 tables for the reflected polynomial 0xEDB88320
+struct Crc32Tables {
+	uint32_t table[8][256];
+
+	Crc32Tables() {
+		for (uint32_t i = 0; i < 256; i++) {
+			uint32_t c = i;
+			for (int k = 0; k < 8; k++) {
+				c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+			}
+			table[0][i] = c;
+		}
+		for (uint32_t i = 0; i < 256; i++) {
+			for (int t = 1; t < 8; t++) {
+				table[t][i] = (table[t - 1][i] >> 8)
+						^ table[0][table[t - 1][i] & 0xFF];
+			}
+		}
+	}
+};
+
+const Crc32Tables crc_tables;
+
+// works on the inverted crc
+uint32_t crc32_generic(const uint8_t *buf, uint64_t len, uint32_t crc) {
+	auto &t = crc_tables.table;
+	while (len >= 8) {
+		uint32_t lo = crc ^ (buf[0] | buf[1] << 8 | buf[2] << 16 | (uint32_t) buf[3] << 24);
+		uint32_t hi = buf[4] | buf[5] << 8 | buf[6] << 16 | (uint32_t) buf[7] << 24;
+		crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF]
+				^ t[4][lo >> 24] ^ t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF]
+				^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+		buf += 8;
+		len -= 8;
+	}
+	while (len--) {
+		crc = t[0][(crc ^ *buf++) & 0xFF] ^ (crc >> 8);
+	}
+	return crc;
+}
+
+#ifdef MINIPARQUET_HAVE_PCLMUL
+
+// folding with carry-less multiplication, see Gopal et al., "Fast CRC Computation for Generic
+// Polynomials Using PCLMULQDQ Instruction". Needs len >= 64 and a multiple of 16, works on the inverted crc.
+__attribute__((target("sse2,pclmul")))
+uint32_t crc32_pclmul(const uint8_t *buf, uint64_t len, uint32_t crc) {
+	// bit-reflected folding constants and Barrett reduction constants for the CRC-32 polynomial
+	const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+	const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+	const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124);
+	const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+	const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+
+	__m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+	x1 = _mm_loadu_si128((const __m128i*) (buf + 0x00));
+	x2 = _mm_loadu_si128((const __m128i*) (buf + 0x10));
+	x3 = _mm_loadu_si128((const __m128i*) (buf + 0x20));
+	x4 = _mm_loadu_si128((const __m128i*) (buf + 0x30));
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+	buf += 64;
+	len -= 64;
+
+	// fold four lanes of 128 bits in parallel
+	x0 = k1k2;
+	while (len >= 64) {
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+		x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+		x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+				_mm_loadu_si128((const __m128i*) (buf + 0x00)));
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6),
+				_mm_loadu_si128((const __m128i*) (buf + 0x10)));
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7),
+				_mm_loadu_si128((const __m128i*) (buf + 0x20)));
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8),
+				_mm_loadu_si128((const __m128i*) (buf + 0x30)));
+		buf += 64;
+		len -= 64;
+	}
+
+	// fold the four lanes into one
+	x0 = k3k4;
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+	// remaining 16 byte blocks
+	while (len >= 16) {
+		x2 = _mm_loadu_si128((const __m128i*) buf);
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+		buf += 16;
+		len -= 16;
+	}
+
+	// 128 to 64 bits
+	x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+
+	x0 = k5k0;
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, mask32);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	// Barrett reduction to 32 bits
+	x0 = poly;
+	x2 = _mm_and_si128(x1, mask32);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+	x2 = _mm_and_si128(x2, mask32);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	return _mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+}
+
+// MINIPARQUET_SIMD=generic turns this off as well
+const bool have_pclmul = __builtin_cpu_supports("pclmul")
+		&& __builtin_cpu_supports("sse2")
+		&& simd::level() != simd::Level::GENERIC;
+
+#endif
+
+}
+
+uint32_t miniparquet::crc32(const char *data, uint64_t len, uint32_t crc) {
+	auto buf = (const uint8_t*) data;
+	crc = ~crc;
+#ifdef MINIPARQUET_HAVE_PCLMUL
+	if (have_pclmul && len >= 64) {
+		auto simd_len = len & ~(uint64_t) 15;
+		crc = crc32_pclmul(buf, simd_len, crc);
+		buf += simd_len;
+		len -= simd_len;
+	}
+#endif
+	return ~crc32_generic(buf, len, crc);
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstdint>
+
+namespace miniparquet {
+
+// standard (zlib/gzip) CRC-32 as used for Parquet page checksums. Pass the result of
+// a previous call as crc to continue a checksum. Uses carry-less multiplication if the CPU has it.
+uint32_t crc32(const char *data, uint64_t len, uint32_t crc = 0);
+
+}
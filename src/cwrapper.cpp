@@ -0,0 +1,257 @@
+#include <cstring>
+#include <algorithm>
+#include <new>
+
+#include "miniparquet.h"
+#include "miniparquet_c.h"
+
+using namespace miniparquet;
+using namespace std;
+
+struct mp_file {
+	unique_ptr<ParquetFile> file;
+	vector<mp_column> columns;
+	vector<uint64_t> column_ids;
+	ScanState state;
+	ResultChunk result;
+	// rows of result handed out already
+	uint64_t result_offset = 0;
+};
+
+static thread_local string last_error;
+
+static mp_status fail(mp_status status, const string &message) {
+	last_error = message;
+	return status;
+}
+
+// runs fun, turning exceptions into status codes
+template<class FUN>
+static mp_status guarded(FUN fun) {
+	try {
+		return fun();
+	} catch (std::bad_alloc &ex) {
+		return fail(MP_OUT_OF_MEMORY, "Out of memory");
+	} catch (std::exception &ex) {
+		return fail(MP_ERROR, ex.what());
+	}
+}
+
+static int32_t value_width(ParquetColumn &col) {
+	switch (col.type) {
+	case parquet::format::Type::BOOLEAN:
+		return 1;
+	case parquet::format::Type::INT32:
+	case parquet::format::Type::FLOAT:
+		return 4;
+	case parquet::format::Type::INT64:
+	case parquet::format::Type::DOUBLE:
+		return 8;
+	case parquet::format::Type::INT96:
+		return sizeof(Int96);
+	case parquet::format::Type::FIXED_LEN_BYTE_ARRAY:
+		return col.schema_element->type_length;
+	default:
+		return 0;
+	}
+}
+
+static void reset_scan(mp_file &f) {
+	f.file->initialize_result(f.result, f.column_ids);
+	f.result.nrows = 0;
+	f.state = ScanState();
+	f.result_offset = 0;
+}
+
+static mp_status open_file(unique_ptr<ParquetFile> file, mp_file **out) {
+	unique_ptr<mp_file> res(new mp_file());
+	res->file = move(file);
+	for (uint64_t col_idx = 0; col_idx < res->file->columns.size(); col_idx++) {
+		auto &col = *res->file->columns[col_idx];
+		auto &s_ele = *col.schema_element;
+		mp_column info;
+		info.name = col.name.c_str();
+		info.type = (mp_type) col.type;
+		info.width = value_width(col);
+		info.converted_type =
+				s_ele.__isset.converted_type ? (int32_t) s_ele.converted_type : -1;
+		info.precision = s_ele.__isset.precision ? s_ele.precision : 0;
+		info.scale = s_ele.__isset.scale ? s_ele.scale : 0;
+		res->columns.push_back(info);
+		res->column_ids.push_back(col_idx);
+	}
+	reset_scan(*res);
+	*out = res.release();
+	return MP_OK;
+}
+
+extern "C" {
+
+const char* mp_last_error(void) {
+	return last_error.c_str();
+}
+
+mp_status mp_open(const char *filename, mp_file **out) {
+	if (!filename || !out) {
+		return fail(MP_INVALID_ARGUMENT, "Need a file name and a handle");
+	}
+	*out = nullptr;
+	return guarded([&]() -> mp_status {
+		return open_file(unique_ptr<ParquetFile>(new ParquetFile(filename)), out);
+	});
+}
+
+mp_status mp_open_buffer(const void *buf, uint64_t len, mp_file **out) {
+	if (!buf || !out) {
+		return fail(MP_INVALID_ARGUMENT, "Need a buffer and a handle");
+	}
+	*out = nullptr;
+	return guarded([&]() -> mp_status {
+		return open_file(
+				unique_ptr<ParquetFile>(new ParquetFile((const char*) buf, len)),
+				out);
+	});
+}
+
+mp_status mp_schema(mp_file *file, uint64_t *ncols, const mp_column **cols,
+		uint64_t *nrows) {
+	if (!file || !ncols || !cols || !nrows) {
+		return fail(MP_INVALID_ARGUMENT, "Need a handle and outputs");
+	}
+	*ncols = file->columns.size();
+	*cols = file->columns.data();
+	*nrows = file->file->nrow;
+	return MP_OK;
+}
+
+mp_status mp_project(mp_file *file, const uint64_t *col_ids, uint64_t ncols) {
+	if (!file || (!col_ids && ncols > 0)) {
+		return fail(MP_INVALID_ARGUMENT, "Need a handle and column ids");
+	}
+	for (uint64_t i = 0; i < ncols; i++) {
+		if (col_ids[i] >= file->columns.size()) {
+			return fail(MP_INVALID_ARGUMENT, "Column index out of range");
+		}
+	}
+	return guarded([&]() -> mp_status {
+		file->column_ids.assign(col_ids, col_ids + ncols);
+		reset_scan(*file);
+		return MP_OK;
+	});
+}
+
+mp_status mp_scan_next_batch(mp_file *file, mp_buffer *buffers,
+		uint64_t capacity, uint64_t *nrows) {
+	if (!file || !nrows || capacity == 0
+			|| (!buffers && !file->column_ids.empty())) {
+		return fail(MP_INVALID_ARGUMENT,
+				"Need a handle, buffers and a capacity");
+	}
+	*nrows = 0;
+	auto &result = file->result;
+	for (size_t col_idx = 0; col_idx < result.cols.size(); col_idx++) {
+		if (!buffers[col_idx].values
+				|| (result.cols[col_idx].col->type
+						== parquet::format::Type::BYTE_ARRAY
+						&& !buffers[col_idx].offsets)) {
+			return fail(MP_INVALID_ARGUMENT,
+					"Missing buffer for column "
+							+ result.cols[col_idx].col->name);
+		}
+	}
+	return guarded([&]() -> mp_status {
+		// empty row groups are skipped
+		while (file->result_offset >= result.nrows) {
+			if (!file->file->scan(file->state, result)) {
+				return MP_OK;
+			}
+			file->result_offset = 0;
+		}
+		auto start = file->result_offset;
+		auto batch_rows = min(capacity, result.nrows - start);
+
+		// cut the batch where the strings stop fitting
+		for (size_t col_idx = 0; col_idx < result.cols.size(); col_idx++) {
+			auto &col = result.cols[col_idx];
+			if (col.col->type != parquet::format::Type::BYTE_ARRAY) {
+				continue;
+			}
+			auto src = (char**) col.data.ptr;
+			uint64_t bytes = 0;
+			for (uint64_t row_idx = 0; row_idx < batch_rows; row_idx++) {
+				if (!col.defined.ptr[start + row_idx]) {
+					continue;
+				}
+				bytes += strlen(src[start + row_idx]);
+				if (bytes > buffers[col_idx].values_size) {
+					batch_rows = row_idx;
+					break;
+				}
+			}
+		}
+		if (batch_rows == 0) {
+			return fail(MP_BUFFER_TOO_SMALL,
+					"String does not fit into the values buffer");
+		}
+
+		for (size_t col_idx = 0; col_idx < result.cols.size(); col_idx++) {
+			auto &col = result.cols[col_idx];
+			auto &buf = buffers[col_idx];
+			auto defined = (uint8_t*) col.defined.ptr + start;
+			if (buf.defined) {
+				memcpy(buf.defined, defined, batch_rows);
+			}
+			switch (col.col->type) {
+			case parquet::format::Type::BYTE_ARRAY: {
+				auto src = (char**) col.data.ptr + start;
+				auto dest = (char*) buf.values;
+				int64_t offset = 0;
+				for (uint64_t row_idx = 0; row_idx < batch_rows; row_idx++) {
+					buf.offsets[row_idx] = offset;
+					if (defined[row_idx]) {
+						auto len = strlen(src[row_idx]);
+						memcpy(dest + offset, src[row_idx], len);
+						offset += len;
+					}
+				}
+				buf.offsets[batch_rows] = offset;
+				break;
+			}
+			case parquet::format::Type::FIXED_LEN_BYTE_ARRAY: {
+				auto src = (char**) col.data.ptr + start;
+				auto width = file->columns[file->column_ids[col_idx]].width;
+				auto dest = (char*) buf.values;
+				for (uint64_t row_idx = 0; row_idx < batch_rows; row_idx++) {
+					if (defined[row_idx]) {
+						memcpy(dest + row_idx * width, src[row_idx], width);
+					} else {
+						memset(dest + row_idx * width, 0, width);
+					}
+				}
+				break;
+			}
+			default: {
+				// everything else is stored at its width already
+				auto width = file->columns[file->column_ids[col_idx]].width;
+				auto dest = (char*) buf.values;
+				memcpy(dest, col.data.ptr + start * width, batch_rows * width);
+				for (uint64_t row_idx = 0; row_idx < batch_rows; row_idx++) {
+					if (!defined[row_idx]) {
+						memset(dest + row_idx * width, 0, width);
+					}
+				}
+				break;
+			}
+			}
+		}
+		file->result_offset += batch_rows;
+		*nrows = batch_rows;
+		return MP_OK;
+	});
+}
+
+void mp_close(mp_file *file) {
+	delete file;
+}
+
+}
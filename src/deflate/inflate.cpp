@@ -0,0 +1,450 @@
+#include "inflate.h"
+#include "crc32.h"
+
+#include <cstring>
+
+using namespace miniparquet;
+
+// Decode table entries:
+//   bits 0-4   number of bits to consume
+//   bits 8-11  extra bits for lengths and distances, index bits for subtable pointers
+//   bits 12-15 flags
+//   bits 16-31 payload: literal byte, length or distance base, precode symbol or subtable offset
+static constexpr uint32_t ENTRY_VALID = 1 << 12;
+static constexpr uint32_t ENTRY_LITERAL = 1 << 13;
+static constexpr uint32_t ENTRY_EOB = 1 << 14;
+static constexpr uint32_t ENTRY_SUBTABLE = 1 << 15;
+
+static constexpr uint16_t LENGTH_BASE[] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15,
+		17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227,
+		258 };
+static constexpr uint8_t LENGTH_EXTRA[] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1,
+		2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static constexpr uint16_t DIST_BASE[] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33,
+		49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097,
+		6145, 8193, 12289, 16385, 24577 };
+static constexpr uint8_t DIST_EXTRA[] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5,
+		5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+static constexpr uint8_t PRECODE_ORDER[] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5,
+		11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+// what each symbol decodes to, without the code length
+struct SymbolEntries {
+	uint32_t litlen[288];
+	uint32_t dist[32];
+	uint32_t precode[19];
+
+	SymbolEntries() {
+		for (uint32_t sym = 0; sym < 288; sym++) {
+			if (sym < 256) {
+				litlen[sym] = ENTRY_VALID | ENTRY_LITERAL | sym << 16;
+			} else if (sym == 256) {
+				litlen[sym] = ENTRY_VALID | ENTRY_EOB;
+			} else if (sym < 286) {
+				litlen[sym] = ENTRY_VALID | LENGTH_EXTRA[sym - 257] << 8
+						| (uint32_t) LENGTH_BASE[sym - 257] << 16;
+			} else {
+				litlen[sym] = 0;
+			}
+		}
+		for (uint32_t sym = 0; sym < 32; sym++) {
+			dist[sym] =
+					sym < 30 ?
+							ENTRY_VALID | DIST_EXTRA[sym] << 8
+									| (uint32_t) DIST_BASE[sym] << 16 :
+							0;
+		}
+		for (uint32_t sym = 0; sym < 19; sym++) {
+			precode[sym] = ENTRY_VALID | sym << 16;
+		}
+	}
+};
+
+static const SymbolEntries symbol_entries;
+
+static inline uint32_t reverse_bits(uint32_t code, int len) {
+	uint32_t res = 0;
+	for (int i = 0; i < len; i++) {
+		res = res << 1 | (code & 1);
+		code >>= 1;
+	}
+	return res;
+}
+
+// builds a two-level decode table for a canonical Huffman code given by its code lengths.
+// Codes longer than table_bits go to subtables behind the main table.
+static bool build_table(uint32_t *table, int table_bits, const uint8_t *lens,
+		int num_syms, const uint32_t *entries) {
+	uint32_t count[16] = { 0 };
+	for (int sym = 0; sym < num_syms; sym++) {
+		count[lens[sym]]++;
+	}
+	count[0] = 0;
+
+	int max_len = 0;
+	int32_t left = 1;
+	for (int len = 1; len <= 15; len++) {
+		left = (left << 1) - count[len];
+		if (left < 0) {
+			return false; // over-subscribed
+		}
+		if (count[len]) {
+			max_len = len;
+		}
+	}
+	// incomplete codes are allowed, the unused entries stay invalid
+
+	uint32_t next_code[16];
+	uint32_t code = 0;
+	for (int len = 1; len <= 15; len++) {
+		code = (code + count[len - 1]) << 1;
+		next_code[len] = code;
+	}
+
+	const uint32_t main_size = 1 << table_bits;
+	const int sub_bits = max_len > table_bits ? max_len - table_bits : 0;
+	uint32_t next_sub = main_size;
+	memset(table, 0, main_size * sizeof(uint32_t));
+
+	for (int sym = 0; sym < num_syms; sym++) {
+		int len = lens[sym];
+		if (!len) {
+			continue;
+		}
+		auto rev = reverse_bits(next_code[len]++, len);
+		auto entry = entries[sym];
+		if (len <= table_bits) {
+			for (auto i = rev; i < main_size; i += 1 << len) {
+				table[i] = entry | len;
+			}
+			continue;
+		}
+		auto prefix = rev & (main_size - 1);
+		if (!(table[prefix] & ENTRY_SUBTABLE)) {
+			table[prefix] = ENTRY_SUBTABLE | next_sub << 16 | sub_bits << 8
+					| table_bits;
+			memset(table + next_sub, 0, (1 << sub_bits) * sizeof(uint32_t));
+			next_sub += 1 << sub_bits;
+		}
+		auto sub_table = table + (table[prefix] >> 16);
+		int sub_len = len - table_bits;
+		for (auto i = rev >> table_bits; i < (1u << sub_bits); i += 1 << sub_len) {
+			sub_table[i] = entry | sub_len;
+		}
+	}
+	return true;
+}
+
+static inline uint64_t load64(const uint8_t *p) {
+	uint64_t res;
+	memcpy(&res, p, sizeof(res));
+	return res; // DEFLATE is little-endian, so are we (see also RleBpDecoder)
+}
+
+bool Inflater::inflate(const uint8_t *src, size_t *src_len, uint8_t *dst,
+		size_t *dst_len) {
+	const uint8_t *in = src;
+	const uint8_t *const in_end = src + *src_len;
+	uint8_t *out = dst;
+	uint8_t *const out_end = dst + *dst_len;
+
+	// bit buffer, consumed from the least significant end
+	uint64_t bitbuf = 0;
+	uint32_t bitsleft = 0;
+	// zero bytes we pretended to read past the end of the input
+	uint32_t overrun = 0;
+
+	// fills the bit buffer to at least 56 bits. The fast version loads eight bytes at once and only
+	// advances over the whole bytes that fit, the bits above bitsleft then hold the next input bits.
+#define REFILL() \
+	if (in_end - in >= 8) { \
+		bitbuf |= load64(in) << bitsleft; \
+		in += (63 - bitsleft) >> 3; \
+		bitsleft |= 56; \
+	} else { \
+		bitbuf &= ((uint64_t) 1 << bitsleft) - 1; \
+		while (bitsleft <= 56) { \
+			if (in < in_end) { \
+				bitbuf |= (uint64_t) *in++ << bitsleft; \
+			} else { \
+				overrun++; \
+			} \
+			bitsleft += 8; \
+		} \
+		if (overrun > 16) { \
+			return false; \
+		} \
+	}
+
+#define BITS(n) (uint32_t) (bitbuf & (((uint64_t) 1 << (n)) - 1))
+
+#define CONSUME(n) \
+	bitbuf >>= (n); \
+	bitsleft -= (n);
+
+#define DECODE(table, table_bits, entry) \
+	entry = table[BITS(table_bits)]; \
+	if (entry & ENTRY_SUBTABLE) { \
+		CONSUME(table_bits); \
+		entry = table[(entry >> 16) + BITS((entry >> 8) & 15)]; \
+	} \
+	if (!(entry & ENTRY_VALID)) { \
+		return false; \
+	} \
+	CONSUME(entry & 31);
+
+	bool final_block = false;
+	while (!final_block) {
+		REFILL();
+		final_block = BITS(1);
+		auto block_type = (bitbuf >> 1) & 3;
+		CONSUME(3);
+
+		if (block_type == 0) {
+			// stored block: byte-aligned length, its complement and raw bytes
+			CONSUME(bitsleft & 7);
+			REFILL();
+			auto len = BITS(16);
+			auto nlen = (bitbuf >> 16) & 0xFFFF;
+			CONSUME(32);
+			if (len != (~nlen & 0xFFFF)) {
+				return false;
+			}
+			// hand the whole bytes still in the bit buffer back to the input
+			if ((bitsleft >> 3) < overrun) {
+				return false;
+			}
+			in -= (bitsleft >> 3) - overrun;
+			bitbuf = 0;
+			bitsleft = 0;
+			overrun = 0;
+			if ((size_t) (in_end - in) < len || (size_t) (out_end - out) < len) {
+				return false;
+			}
+			memcpy(out, in, len);
+			in += len;
+			out += len;
+			continue;
+		}
+
+		if (block_type == 1) {
+			// fixed Huffman codes, could be cached but these blocks are rare
+			uint8_t lens[288 + 32];
+			memset(lens, 8, 144);
+			memset(lens + 144, 9, 112);
+			memset(lens + 256, 7, 24);
+			memset(lens + 280, 8, 8);
+			memset(lens + 288, 5, 32);
+			if (!build_table(litlen_table, LITLEN_TABLE_BITS, lens, 288,
+					symbol_entries.litlen)
+					|| !build_table(dist_table, DIST_TABLE_BITS, lens + 288, 32,
+							symbol_entries.dist)) {
+				return false;
+			}
+		} else if (block_type == 2) {
+			// dynamic Huffman codes, their lengths are Huffman coded themselves with the precode
+			uint32_t num_litlen = BITS(5) + 257;
+			uint32_t num_dist = ((bitbuf >> 5) & 31) + 1;
+			uint32_t num_precode = ((bitbuf >> 10) & 15) + 4;
+			CONSUME(14);
+			if (num_litlen > 286 || num_dist > 30) {
+				return false;
+			}
+
+			uint8_t precode_lens[19] = { 0 };
+			for (uint32_t i = 0; i < num_precode; i++) {
+				// 19 lengths of 3 bits do not fit in one refill
+				REFILL();
+				precode_lens[PRECODE_ORDER[i]] = BITS(3);
+				CONSUME(3);
+			}
+			if (!build_table(precode_table, PRECODE_TABLE_BITS, precode_lens, 19,
+					symbol_entries.precode)) {
+				return false;
+			}
+
+			uint8_t lens[288 + 32];
+			uint32_t i = 0;
+			while (i < num_litlen + num_dist) {
+				REFILL();
+				uint32_t entry;
+				DECODE(precode_table, PRECODE_TABLE_BITS, entry);
+				auto sym = entry >> 16;
+				if (sym < 16) {
+					lens[i++] = sym;
+					continue;
+				}
+				uint8_t rep_val = 0;
+				uint32_t rep_count;
+				if (sym == 16) {
+					if (i == 0) {
+						return false;
+					}
+					rep_val = lens[i - 1];
+					rep_count = 3 + BITS(2);
+					CONSUME(2);
+				} else if (sym == 17) {
+					rep_count = 3 + BITS(3);
+					CONSUME(3);
+				} else {
+					rep_count = 11 + BITS(7);
+					CONSUME(7);
+				}
+				if (i + rep_count > num_litlen + num_dist) {
+					return false;
+				}
+				memset(lens + i, rep_val, rep_count);
+				i += rep_count;
+			}
+			if (lens[256] == 0) {
+				return false; // no end of block code
+			}
+			if (!build_table(litlen_table, LITLEN_TABLE_BITS, lens, num_litlen,
+					symbol_entries.litlen)
+					|| !build_table(dist_table, DIST_TABLE_BITS, lens + num_litlen,
+							num_dist, symbol_entries.dist)) {
+				return false;
+			}
+		} else {
+			return false;
+		}
+
+		// decode literals and matches until the end of the block. One refill gives
+		// at least 56 bits, enough for a length code, its extra bits, a distance code and its extra bits.
+		while (true) {
+			REFILL();
+			uint32_t entry;
+			DECODE(litlen_table, LITLEN_TABLE_BITS, entry);
+			if (entry & ENTRY_LITERAL) {
+				if (out == out_end) {
+					return false;
+				}
+				*out++ = entry >> 16;
+				continue;
+			}
+			if (entry & ENTRY_EOB) {
+				break;
+			}
+			uint32_t length = (entry >> 16) + BITS((entry >> 8) & 15);
+			CONSUME((entry >> 8) & 15);
+
+			DECODE(dist_table, DIST_TABLE_BITS, entry);
+			uint32_t dist = (entry >> 16) + BITS((entry >> 8) & 15);
+			CONSUME((entry >> 8) & 15);
+
+			if (dist > (size_t) (out - dst) || length > (size_t) (out_end - out)) {
+				return false;
+			}
+			const uint8_t *match = out - dist;
+			uint8_t *const match_end = out + length;
+
+			if ((size_t) (out_end - match_end) >= 8) {
+				// there is room to overshoot, copy eight bytes at a time
+				if (dist >= 8) {
+					do {
+						uint64_t word = load64(match);
+						memcpy(out, &word, 8);
+						match += 8;
+						out += 8;
+					} while (out < match_end);
+				} else if (dist == 1) {
+					memset(out, *match, length);
+				} else {
+					// expand the pattern to eight bytes, then repeat it in steps of a multiple of dist
+					for (int k = 0; k < 8; k++) {
+						out[k] = match[k];
+					}
+					const uint32_t step = dist * (8 / dist);
+					for (uint8_t *pos = out + step; pos < match_end; pos += step) {
+						uint64_t word = load64(pos - step);
+						memcpy(pos, &word, 8);
+					}
+				}
+			} else {
+				while (out < match_end) {
+					*out++ = *match++;
+				}
+			}
+			out = match_end;
+		}
+	}
+
+	// give back the whole bytes we read ahead
+	if ((bitsleft >> 3) < overrun) {
+		return false;
+	}
+	in -= (bitsleft >> 3) - overrun;
+	*src_len = in - src;
+	*dst_len = out - dst;
+	return true;
+
+#undef REFILL
+#undef BITS
+#undef CONSUME
+#undef DECODE
+}
+
+bool Inflater::uncompress(const char *src_ptr, size_t src_len, char *dst_ptr,
+		size_t dst_len) {
+	auto src = (const uint8_t*) src_ptr;
+	auto src_end = src + src_len;
+	auto dst = (uint8_t*) dst_ptr;
+	auto dst_end = dst + dst_len;
+
+	if (src_len >= 2 && src[0] == 0x78 && (src[0] << 8 | src[1]) % 31 == 0) {
+		// zlib, the adler32 trailer is not checked
+		size_t in_len = src_len - 2, out_len = dst_len;
+		return inflate(src + 2, &in_len, dst, &out_len) && out_len == dst_len
+				&& in_len + 4 <= src_len - 2;
+	}
+
+	// gzip, possibly several concatenated members
+	do {
+		if (src_end - src < 18 || src[0] != 0x1f || src[1] != 0x8b
+				|| src[2] != 8) {
+			return false;
+		}
+		uint8_t flags = src[3];
+		auto pos = src + 10;
+		if (flags & 4) { // FEXTRA
+			if (src_end - pos < 2) {
+				return false;
+			}
+			pos += 2 + (pos[0] | pos[1] << 8);
+		}
+		for (int field = 8; field <= 16; field <<= 1) { // FNAME, FCOMMENT
+			if (flags & field) {
+				while (pos < src_end && *pos) {
+					pos++;
+				}
+				pos++;
+			}
+		}
+		if (flags & 2) { // FHCRC
+			pos += 2;
+		}
+		if (pos >= src_end) {
+			return false;
+		}
+
+		size_t in_len = src_end - pos, out_len = dst_end - dst;
+		if (!inflate(pos, &in_len, dst, &out_len)) {
+			return false;
+		}
+		pos += in_len;
+		if (src_end - pos < 8) {
+			return false;
+		}
+		uint32_t crc, isize;
+		memcpy(&crc, pos, 4);
+		memcpy(&isize, pos + 4, 4);
+		if (isize != (uint32_t) out_len
+				|| crc != crc32((const char*) dst, out_len)) {
+			return false;
+		}
+		src = pos + 8;
+		dst += out_len;
+	} while (dst < dst_end);
+
+	return true;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace miniparquet {
+
+// table-driven DEFLATE (RFC 1951) decoder. Keeps its Huffman tables between calls,
+// so keep one around per thread instead of creating one per page.
+class Inflater {
+public:
+	// Decompresses gzip (RFC 1952, one or more members) or zlib (RFC 1950) data into exactly
+	// dst_len bytes. Returns false if the input is corrupt or does not decompress to dst_len bytes.
+	bool uncompress(const char *src, size_t src_len, char *dst, size_t dst_len);
+
+	// decodes a raw DEFLATE stream, *src_len is set to the number of bytes consumed
+	// and *dst_len to the number of bytes produced
+	bool inflate(const uint8_t *src, size_t *src_len, uint8_t *dst,
+			size_t *dst_len);
+
+private:
+	static constexpr int LITLEN_TABLE_BITS = 10;
+	static constexpr int DIST_TABLE_BITS = 8;
+	static constexpr int PRECODE_TABLE_BITS = 7;
+	static constexpr int MAX_CODE_LEN = 15;
+
+	// main table plus room for one subtable of the maximum size per symbol
+	uint32_t litlen_table[(1 << LITLEN_TABLE_BITS)
+			+ 288 * (1 << (MAX_CODE_LEN - LITLEN_TABLE_BITS))];
+	uint32_t dist_table[(1 << DIST_TABLE_BITS)
+			+ 32 * (1 << (MAX_CODE_LEN - DIST_TABLE_BITS))];
+	uint32_t precode_table[1 << PRECODE_TABLE_BITS];
+};
+
+}
@@ -0,0 +1,430 @@
+#include <string>
+#include <sstream>
+#include <cstdio>
+#include <stdexcept>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <future>
+
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netdb.h>
+#include <unistd.h>
+#endif
+
+#include "miniparquet.h"
+
+using namespace std;
+using namespace miniparquet;
+
+// enough for the magic bytes, the footer length and most footers
+static constexpr uint64_t SPECULATIVE_TAIL_SIZE = 64 * 1024;
+
+#ifndef _WIN32
+
+#ifdef MSG_NOSIGNAL
+static constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+static constexpr int SEND_FLAGS = 0;
+#endif
+
+static bool equals_ci(const string &a, const string &b) {
+	return a.size() == b.size()
+			&& equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+				return tolower(x) == tolower(y);
+			});
+}
+
+static bool header_is(const string &line, const string &name, string &value) {
+	if (line.size() <= name.size() || line[name.size()] != ':'
+			|| !equals_ci(line.substr(0, name.size()), name)) {
+		return false;
+	}
+	auto start = line.find_first_not_of(' ', name.size() + 1);
+	value = start == string::npos ? "" : line.substr(start);
+	return true;
+}
+
+HttpSource::HttpSource(std::string url) {
+	const string scheme = "http://";
+	if (url.compare(0, scheme.size(), scheme) != 0) {
+		throw runtime_error("Only http:// URLs are supported: " + url);
+	}
+	auto host_end = url.find('/', scheme.size());
+	auto authority = url.substr(scheme.size(),
+			host_end == string::npos ? string::npos : host_end - scheme.size());
+	path = host_end == string::npos ? "/" : url.substr(host_end);
+	auto colon = authority.rfind(':');
+	if (colon != string::npos) {
+		host = authority.substr(0, colon);
+		port = authority.substr(colon + 1);
+	} else {
+		host = authority;
+		port = "80";
+	}
+	if (host.empty()) {
+		throw runtime_error("Invalid URL " + url);
+	}
+
+	// the start magic bytes and the tail of the file are fetched in parallel, the suffix
+	// range request does not need to know the file size and tells us the size in its response.
+	// The head request waits for the status of the tail one, a server that ignores ranges
+	// would send the whole file twice.
+	promise<int> tail_promise;
+	auto tail_known = tail_promise.get_future();
+	bool tail_signalled = false;
+	auto signal_tail = [&](int status) {
+		if (!tail_signalled) {
+			tail_signalled = true;
+			tail_promise.set_value(status);
+		}
+	};
+	string head_body, head_range;
+	int head_status = 0;
+	string head_error;
+	thread head_thread([&]() {
+		if (tail_known.get() != 206) {
+			return;
+		}
+		try {
+			head_status = get("bytes=0-3", head_body, head_range);
+		} catch (std::exception &e) {
+			head_error = e.what();
+		}
+	});
+
+	string tail_body, tail_range;
+	int tail_status;
+	try {
+		tail_status = get("bytes=-" + to_string(SPECULATIVE_TAIL_SIZE),
+				tail_body, tail_range, signal_tail);
+	} catch (...) {
+		signal_tail(0);
+		head_thread.join();
+		throw;
+	}
+	signal_tail(tail_status);
+	head_thread.join();
+
+	if (tail_status == 200) {
+		// server ignored the range, we got the whole file
+		file_size = tail_body.size();
+		cached.push_back(make_pair(0, move(tail_body)));
+	} else if (tail_status == 206) {
+		// Content-Range: bytes first-last/total
+		auto slash = tail_range.rfind('/');
+		auto dash = tail_range.find('-');
+		auto space = tail_range.find(' ');
+		if (slash == string::npos || dash == string::npos
+				|| space == string::npos) {
+			throw runtime_error("Invalid Content-Range header " + tail_range);
+		}
+		file_size = stoull(tail_range.substr(slash + 1));
+		auto first = stoull(tail_range.substr(space + 1, dash - space - 1));
+		cached.push_back(make_pair(first, move(tail_body)));
+	} else if (tail_status == 416) {
+		file_size = 0;
+	} else {
+		throw runtime_error(
+				"HTTP request for " + url + " failed with status "
+						+ to_string(tail_status));
+	}
+	if (head_error.empty() && head_status == 206) {
+		cached.push_back(make_pair(0, move(head_body)));
+	}
+}
+
+HttpSource::~HttpSource() {
+	for (auto fd : idle) {
+		close(fd);
+	}
+}
+
+int HttpSource::connect_socket() {
+	struct addrinfo hints, *res;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	auto gai = getaddrinfo(host.c_str(), port.c_str(), &hints, &res);
+	if (gai != 0) {
+		throw runtime_error(
+				"Could not resolve " + host + ": " + gai_strerror(gai));
+	}
+	int fd = -1;
+	for (auto ai = res; ai; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (fd < 0) {
+			continue;
+		}
+		if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+			break;
+		}
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(res);
+	if (fd < 0) {
+		throw runtime_error("Could not connect to " + host + ":" + port);
+	}
+	struct timeval timeout;
+	timeout.tv_sec = 60;
+	timeout.tv_usec = 0;
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+#ifdef SO_NOSIGPIPE
+	int one = 1;
+	setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+	return fd;
+}
+
+// issues a GET with the given Range header and returns the status code
+int HttpSource::get(std::string range, std::string &body,
+		std::string &content_range, std::function<void(int)> on_status) {
+	stringstream req;
+	req << "GET " << path << " HTTP/1.1\r\nHost: " << host << "\r\nRange: "
+			<< range << "\r\nConnection: keep-alive\r\n\r\n";
+	auto req_str = req.str();
+
+	// a pooled connection may have been closed by the server in the meantime, retry once on a fresh one
+	for (int attempt = 0; attempt < 2; attempt++) {
+		int fd = -1;
+		bool reused = false;
+		{
+			lock_guard<mutex> guard(idle_lock);
+			if (!idle.empty()) {
+				fd = idle.back();
+				idle.pop_back();
+				reused = true;
+			}
+		}
+		if (fd < 0) {
+			fd = connect_socket();
+		}
+
+		size_t sent = 0;
+		while (sent < req_str.size()) {
+			auto res = send(fd, req_str.data() + sent, req_str.size() - sent,
+					SEND_FLAGS);
+			if (res <= 0) {
+				break;
+			}
+			sent += res;
+		}
+
+		// read until the end of the headers
+		string buf;
+		char tmp[16 * 1024];
+		size_t header_end = string::npos;
+		while (sent == req_str.size()) {
+			auto res = recv(fd, tmp, sizeof(tmp), 0);
+			if (res <= 0) {
+				break;
+			}
+			buf.append(tmp, res);
+			header_end = buf.find("\r\n\r\n");
+			if (header_end != string::npos) {
+				break;
+			}
+		}
+		if (header_end == string::npos) {
+			close(fd);
+			if (reused && attempt == 0) {
+				continue;
+			}
+			throw runtime_error("No HTTP response from " + host);
+		}
+
+		stringstream headers(buf.substr(0, header_end));
+		string line;
+		getline(headers, line);
+		int status = 0;
+		if (sscanf(line.c_str(), "HTTP/%*d.%*d %d", &status) != 1) {
+			close(fd);
+			throw runtime_error("Invalid HTTP response from " + host);
+		}
+		// HTTP/1.0 closes connections unless asked otherwise
+		bool has_length = false, keep_alive = line.compare(0, 8, "HTTP/1.0")
+				!= 0;
+		uint64_t content_length = 0;
+		content_range = "";
+		while (getline(headers, line)) {
+			if (!line.empty() && line.back() == '\r') {
+				line.pop_back();
+			}
+			string value;
+			if (header_is(line, "content-length", value)) {
+				content_length = stoull(value);
+				has_length = true;
+			} else if (header_is(line, "content-range", value)) {
+				content_range = value;
+			} else if (header_is(line, "connection", value)) {
+				keep_alive = equals_ci(value, "keep-alive");
+			} else if (header_is(line, "transfer-encoding", value)) {
+				if (!equals_ci(value, "identity")) {
+					close(fd);
+					throw runtime_error(
+							"Unsupported HTTP transfer encoding " + value);
+				}
+			}
+		}
+
+		if (on_status) {
+			on_status(status);
+		}
+
+		body = buf.substr(header_end + 4);
+		if (has_length) {
+			body.reserve(content_length);
+		}
+		while (!has_length || body.size() < content_length) {
+			auto res = recv(fd, tmp, sizeof(tmp), 0);
+			if (res <= 0) {
+				break;
+			}
+			body.append(tmp, res);
+		}
+		if (has_length && body.size() != content_length) {
+			close(fd);
+			throw runtime_error("Short HTTP response from " + host);
+		}
+
+		if (has_length && keep_alive) {
+			lock_guard<mutex> guard(idle_lock);
+			idle.push_back(fd);
+		} else {
+			close(fd);
+		}
+		return status;
+	}
+	throw runtime_error("No HTTP response from " + host); // unreachable
+}
+
+bool HttpSource::read_cached(uint64_t offset, uint64_t len, char *dest) {
+	for (auto &block : cached) {
+		if (offset >= block.first
+				&& offset + len <= block.first + block.second.size()) {
+			memcpy(dest, block.second.data() + (offset - block.first), len);
+			return true;
+		}
+	}
+	return false;
+}
+
+uint64_t HttpSource::size() {
+	return file_size;
+}
+
+void HttpSource::read(uint64_t offset, uint64_t len, char *dest) {
+	if (offset > file_size || len > file_size - offset) {
+		throw runtime_error("Read beyond end of file. File corrupt?");
+	}
+	if (len == 0 || read_cached(offset, len, dest)) {
+		return;
+	}
+	string body, content_range;
+	auto status = get(
+			"bytes=" + to_string(offset) + "-" + to_string(offset + len - 1),
+			body, content_range);
+	if (status == 200 && body.size() == file_size) {
+		memcpy(dest, body.data() + offset, len);
+		return;
+	}
+	if (status != 206 || body.size() != len) {
+		throw runtime_error(
+				"HTTP range request failed with status " + to_string(status));
+	}
+	memcpy(dest, body.data(), len);
+}
+
+void HttpSource::read_ranges(std::vector<ReadRange> &ranges) {
+	vector<ReadRange> todo;
+	for (auto &range : ranges) {
+		if (range.offset > file_size
+				|| range.len > file_size - range.offset) {
+			throw runtime_error("Read beyond end of file. File corrupt?");
+		}
+		if (range.len > 0 && !read_cached(range.offset, range.len, range.dest)) {
+			todo.push_back(range);
+		}
+	}
+	sort(todo.begin(), todo.end(), [](const ReadRange &a, const ReadRange &b) {
+		return a.offset < b.offset;
+	});
+
+	// coalesce nearby ranges, reading the gap is cheaper than another round trip
+	struct Group {
+		uint64_t start;
+		uint64_t end;
+		size_t first_range;
+		size_t range_count;
+	};
+	vector<Group> groups;
+	for (size_t i = 0; i < todo.size(); i++) {
+		auto end = todo[i].offset + todo[i].len;
+		if (!groups.empty() && todo[i].offset <= groups.back().end + coalesce_gap) {
+			groups.back().end = max(groups.back().end, end);
+			groups.back().range_count++;
+		} else {
+			groups.push_back( { todo[i].offset, end, i, 1 });
+		}
+	}
+
+	atomic<size_t> next_group(0);
+	string error;
+	mutex error_lock;
+	auto worker = [&]() {
+		size_t group_idx;
+		while ((group_idx = next_group++) < groups.size()) {
+			auto &group = groups[group_idx];
+			try {
+				string body(group.end - group.start, '\0');
+				read(group.start, body.size(), &body[0]);
+				for (size_t i = group.first_range;
+						i < group.first_range + group.range_count; i++) {
+					memcpy(todo[i].dest, body.data() + (todo[i].offset - group.start),
+							todo[i].len);
+				}
+			} catch (std::exception &e) {
+				lock_guard<mutex> guard(error_lock);
+				error = e.what();
+			}
+		}
+	};
+
+	auto thread_count = min<size_t>(max_connections, groups.size());
+	vector<thread> threads;
+	for (size_t i = 1; i < thread_count; i++) {
+		threads.push_back(thread(worker));
+	}
+	worker();
+	for (auto &t : threads) {
+		t.join();
+	}
+	if (!error.empty()) {
+		throw runtime_error(error);
+	}
+}
+
+#else
+
+HttpSource::HttpSource(std::string url) {
+	throw runtime_error("HTTP sources are not supported on this platform");
+}
+
+HttpSource::~HttpSource() {
+}
+
+uint64_t HttpSource::size() {
+	return 0;
+}
+
+void HttpSource::read(uint64_t offset, uint64_t len, char *dest) {
+}
+
+void HttpSource::read_ranges(std::vector<ReadRange> &ranges) {
+}
+
+#endif
@@ -0,0 +1,167 @@
+#include "lz4.h"
+
+#include <cstring>
+
+using namespace miniparquet;
+
+static inline void copy8(uint8_t *dst, const uint8_t *src) {
+	uint64_t word;
+	memcpy(&word, src, 8);
+	memcpy(dst, &word, 8);
+}
+
+static inline uint32_t load_be32(const uint8_t *p) {
+	return (uint32_t) p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+// decodes one block, returns the number of bytes written or -1 on corrupt input
+static int64_t decompress_block(const uint8_t *src, size_t src_len,
+		uint8_t *dst, size_t dst_len) {
+	const uint8_t *in = src;
+	const uint8_t *const in_end = src + src_len;
+	uint8_t *out = dst;
+	uint8_t *const out_end = dst + dst_len;
+
+	while (true) {
+		if (in == in_end) {
+			return -1;
+		}
+		uint8_t token = *in++;
+
+		// literals. Short runs with enough room around them are copied 16 bytes at a time,
+		// a run shorter than 15 with more than 16 bytes of input left cannot be the last sequence
+		size_t literal_len = token >> 4;
+		if (literal_len != 15 && in_end - in >= 16 && out_end - out >= 16) {
+			copy8(out, in);
+			copy8(out + 8, in + 8);
+			in += literal_len;
+			out += literal_len;
+		} else {
+			if (literal_len == 15) {
+				uint8_t b;
+				do {
+					if (in == in_end) {
+						return -1;
+					}
+					b = *in++;
+					literal_len += b;
+				} while (b == 255);
+			}
+			if ((size_t) (in_end - in) < literal_len
+					|| (size_t) (out_end - out) < literal_len) {
+				return -1;
+			}
+			memcpy(out, in, literal_len);
+			in += literal_len;
+			out += literal_len;
+			if (in == in_end) {
+				break; // the last sequence has no match
+			}
+		}
+
+		// match
+		if (in_end - in < 2) {
+			return -1;
+		}
+		size_t offset = in[0] | in[1] << 8;
+		in += 2;
+		if (offset == 0 || offset > (size_t) (out - dst)) {
+			return -1;
+		}
+		size_t match_len = token & 15;
+		if (match_len == 15) {
+			uint8_t b;
+			do {
+				if (in == in_end) {
+					return -1;
+				}
+				b = *in++;
+				match_len += b;
+			} while (b == 255);
+		}
+		match_len += 4;
+		if ((size_t) (out_end - out) < match_len) {
+			return -1;
+		}
+
+		const uint8_t *match = out - offset;
+		uint8_t *const match_end = out + match_len;
+		if (out_end - match_end >= 8) {
+			// there is room to overshoot, copy eight bytes at a time
+			if (offset >= 8) {
+				do {
+					copy8(out, match);
+					match += 8;
+					out += 8;
+				} while (out < match_end);
+			} else if (offset == 1) {
+				memset(out, *match, match_len);
+			} else {
+				// expand the pattern to eight bytes, then repeat it in steps of a multiple of offset
+				for (int k = 0; k < 8; k++) {
+					out[k] = match[k];
+				}
+				const size_t step = offset * (8 / offset);
+				for (uint8_t *pos = out + step; pos < match_end; pos += step) {
+					copy8(pos, pos - step);
+				}
+			}
+		} else {
+			while (out < match_end) {
+				*out++ = *match++;
+			}
+		}
+		out = match_end;
+	}
+	return out - dst;
+}
+
+bool miniparquet::lz4_uncompress(const char *src, size_t src_len, char *dst,
+		size_t dst_len) {
+	return decompress_block((const uint8_t*) src, src_len, (uint8_t*) dst,
+			dst_len) == (int64_t) dst_len;
+}
+
+static bool uncompress_hadoop_frames(const uint8_t *src, size_t src_len,
+		uint8_t *dst, size_t dst_len) {
+	auto in = src;
+	auto in_end = src + src_len;
+	auto out = dst;
+	auto out_end = dst + dst_len;
+
+	while (in < in_end) {
+		if (in_end - in < 4) {
+			return false;
+		}
+		size_t frame_len = load_be32(in);
+		in += 4;
+		if ((size_t) (out_end - out) < frame_len) {
+			return false;
+		}
+		auto frame_end = out + frame_len;
+		while (out < frame_end) {
+			if (in_end - in < 4) {
+				return false;
+			}
+			size_t block_len = load_be32(in);
+			in += 4;
+			if ((size_t) (in_end - in) < block_len) {
+				return false;
+			}
+			auto res = decompress_block(in, block_len, out, frame_end - out);
+			if (res <= 0) {
+				return false;
+			}
+			in += block_len;
+			out += res;
+		}
+	}
+	return out == out_end;
+}
+
+bool miniparquet::lz4_uncompress_hadoop(const char *src, size_t src_len,
+		char *dst, size_t dst_len) {
+	return uncompress_hadoop_frames((const uint8_t*) src, src_len,
+			(uint8_t*) dst, dst_len)
+			|| lz4_uncompress(src, src_len, dst, dst_len);
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace miniparquet {
+
+// decompresses a single LZ4 block (the LZ4_RAW codec) into exactly dst_len bytes.
+// Returns false if the input is corrupt or does not decompress to dst_len bytes.
+bool lz4_uncompress(const char *src, size_t src_len, char *dst, size_t dst_len);
+
+// decompresses the Hadoop framing used by the legacy LZ4 codec: frames of a big-endian uncompressed
+// length followed by big-endian length-prefixed LZ4 blocks. Like other readers we fall back to a
+// single raw block, since some writers used the LZ4 codec for that.
+bool lz4_uncompress_hadoop(const char *src, size_t src_len, char *dst,
+		size_t dst_len);
+
+}
@@ -4,9 +4,18 @@
 #include <sstream>
 #include <math.h>
 
-#include "snappy/snappy.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
 
 #include "miniparquet.h"
+#include "crc32.h"
+#include "simd/simd.h"
 
 #include <protocol/TCompactProtocol.h>
 #include <transport/TBufferTransports.h>
@@ -21,6 +30,8 @@ using namespace apache::thrift::transport;
 
 using namespace miniparquet;
 
+constexpr uint32_t ResultColumn::NO_DICT_INDEX;
+
 static TCompactProtocolFactoryT<TMemoryBuffer> tproto_factory;
 
 template<class T>
@@ -40,46 +51,317 @@ static void thrift_unpack(const uint8_t *buf, uint32_t *len,
 	*len = *len - bytes_left;
 }
 
-ParquetFile::ParquetFile(std::string filename) {
-	initialize(filename);
+#ifdef _WIN32
+static int64_t pread(int fd, void *buf, size_t count, int64_t offset) {
+	if (_lseeki64(fd, offset, SEEK_SET) != offset) {
+		return -1;
+	}
+	return _read(fd, buf, count);
+}
+#endif
+
+FileSource::FileSource(std::string filename) {
+#ifdef _WIN32
+	fd = _open(filename.c_str(), _O_RDONLY | _O_BINARY);
+#else
+	fd = open(filename.c_str(), O_RDONLY);
+#endif
+	if (fd < 0) {
+		throw runtime_error("Could not open file " + filename);
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		throw runtime_error("Could not stat file " + filename);
+	}
+	file_size = st.st_size;
 }
 
-void ParquetFile::initialize(string filename) {
-	ByteBuffer buf;
-	pfile.open(filename, std::ios::binary);
+FileSource::FileSource(int fd) :
+		fd(fd) {
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		throw runtime_error("Invalid file descriptor");
+	}
+	file_size = st.st_size;
+}
+
+FileSource::~FileSource() {
+	close(fd);
+}
+
+uint64_t FileSource::size() {
+	return file_size;
+}
+
+void FileSource::read(uint64_t offset, uint64_t len, char *dest) {
+	if (offset > file_size || len > file_size - offset) {
+		throw runtime_error("Read beyond end of file. File corrupt?");
+	}
+	while (len > 0) {
+		auto res = pread(fd, dest, len, offset);
+		if (res <= 0) {
+			throw runtime_error("Could not read from file");
+		}
+		dest += res;
+		offset += res;
+		len -= res;
+	}
+}
+
+void FileSource::will_need(uint64_t offset, uint64_t len) {
+#ifdef POSIX_FADV_WILLNEED
+	posix_fadvise(fd, offset, len, POSIX_FADV_WILLNEED);
+#endif
+}
+
+void FileSource::dont_need(uint64_t offset, uint64_t len) {
+#ifdef POSIX_FADV_DONTNEED
+	posix_fadvise(fd, offset, len, POSIX_FADV_DONTNEED);
+#endif
+}
+
+MemorySource::MemorySource(const char *ptr, uint64_t len) :
+		ptr(ptr), len(len) {
+	if (!ptr && len > 0) {
+		throw runtime_error("Invalid memory buffer");
+	}
+}
+
+uint64_t MemorySource::size() {
+	return len;
+}
+
+const char* MemorySource::view(uint64_t offset, uint64_t len) {
+	if (offset > this->len || len > this->len - offset) {
+		throw runtime_error("Read beyond end of file. File corrupt?");
+	}
+	return ptr + offset;
+}
+
+void MemorySource::read(uint64_t offset, uint64_t len, char *dest) {
+	memcpy(dest, view(offset, len), len);
+}
+
+#ifndef _WIN32
+MmapSource::MmapSource(std::string filename) {
+	auto fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw runtime_error("Could not open file " + filename);
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		throw runtime_error("Could not stat file " + filename);
+	}
+	len = st.st_size;
+	if (len > 0) {
+		auto res = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (res == MAP_FAILED) {
+			close(fd);
+			throw runtime_error("Could not map file " + filename);
+		}
+		ptr = (const char*) res;
+	}
+	// the mapping keeps the file alive
+	close(fd);
+}
+
+MmapSource::~MmapSource() {
+	if (ptr) {
+		munmap((void*) ptr, len);
+	}
+}
+
+void MmapSource::advise(uint64_t offset, uint64_t len, int advice) {
+	if (!ptr || offset >= this->len) {
+		return;
+	}
+	// madvise wants page-aligned addresses
+	static const uint64_t page_size = sysconf(_SC_PAGESIZE);
+	auto aligned_offset = offset - offset % page_size;
+	len = std::min(len + (offset - aligned_offset), this->len - aligned_offset);
+	madvise((void*) (ptr + aligned_offset), len, advice);
+}
+
+void MmapSource::will_need(uint64_t offset, uint64_t len) {
+	advise(offset, len, MADV_WILLNEED);
+}
+
+void MmapSource::dont_need(uint64_t offset, uint64_t len) {
+	advise(offset, len, MADV_DONTNEED);
+}
+#else
+MmapSource::MmapSource(std::string filename) {
+	throw runtime_error("mmap is not supported on this platform");
+}
+
+MmapSource::~MmapSource() {
+}
+
+void MmapSource::advise(uint64_t offset, uint64_t len, int advice) {
+}
+
+void MmapSource::will_need(uint64_t offset, uint64_t len) {
+}
+
+void MmapSource::dont_need(uint64_t offset, uint64_t len) {
+}
+#endif
+
+StreamSource::StreamSource(int fd, uint64_t memory_limit) {
+	uint64_t len = 0;
+	FILE *spill = nullptr;
+	buffer.resize(64 * 1024);
+	while (true) {
+		if (len == buffer.len) {
+			if (!spill && len >= memory_limit) {
+				spill = tmpfile();
+				if (!spill) {
+					throw runtime_error("Could not create temporary file");
+				}
+			}
+			if (spill) {
+				// keep the buffer size, write it out whenever it is full
+				if (fwrite(buffer.ptr, 1, len, spill) != len) {
+					fclose(spill);
+					throw runtime_error("Could not write temporary file");
+				}
+				len = 0;
+			} else {
+				buffer.resize(std::min(buffer.len * 2, memory_limit));
+			}
+		}
+		auto res = ::read(fd, buffer.ptr + len, buffer.len - len);
+		if (res < 0) {
+			if (spill) {
+				fclose(spill);
+			}
+			throw runtime_error("Could not read from stream");
+		}
+		if (res == 0) {
+			break;
+		}
+		len += res;
+	}
+
+	if (!spill) {
+		spooled = unique_ptr<ParquetSource>(new MemorySource(buffer.ptr, len));
+		return;
+	}
+	auto written = fwrite(buffer.ptr, 1, len, spill) == len && fflush(spill) == 0;
+	// the temporary file is deleted once the last descriptor to it is closed
+	auto spill_fd = written ? dup(fileno(spill)) : -1;
+	fclose(spill);
+	if (spill_fd < 0) {
+		throw runtime_error("Could not write temporary file");
+	}
+	spooled = unique_ptr<ParquetSource>(new FileSource(spill_fd));
+	ByteBuffer empty;
+	buffer = move(empty);
+}
+
+uint64_t StreamSource::size() {
+	return spooled->size();
+}
+
+void StreamSource::read(uint64_t offset, uint64_t len, char *dest) {
+	spooled->read(offset, len, dest);
+}
+
+const char* StreamSource::view(uint64_t offset, uint64_t len) {
+	return spooled->view(offset, len);
+}
+
+void StreamSource::will_need(uint64_t offset, uint64_t len) {
+	spooled->will_need(offset, len);
+}
+
+void StreamSource::dont_need(uint64_t offset, uint64_t len) {
+	spooled->dont_need(offset, len);
+}
+
+ParquetFile::ParquetFile(std::string filename, FileAccess access) {
+#ifdef _WIN32
+	access = FileAccess::READ;
+#endif
+	if (filename == "-") {
+		source = unique_ptr<ParquetSource>(new StreamSource(0));
+	} else if (filename.compare(0, 7, "http://") == 0) {
+		source = unique_ptr<ParquetSource>(new HttpSource(filename));
+	} else if (access == FileAccess::MMAP) {
+		source = unique_ptr<ParquetSource>(new MmapSource(filename));
+	} else {
+		source = unique_ptr<ParquetSource>(new FileSource(filename));
+	}
+	initialize();
+}
+
+ParquetFile::ParquetFile(const char *buf, uint64_t len) :
+		source(new MemorySource(buf, len)) {
+	initialize();
+}
+
+ParquetFile::ParquetFile(std::unique_ptr<ParquetSource> source) :
+		source(move(source)) {
+	if (!this->source) {
+		throw runtime_error("Need a source to read from");
+	}
+	initialize();
+}
+
+void ParquetSource::read_ranges(std::vector<ReadRange> &ranges) {
+	for (auto &range : ranges) {
+		read(range.offset, range.len, range.dest);
+	}
+}
+
+// most footers fit in here, so we usually get away with a single read from the end of the file
+static constexpr uint64_t FOOTER_READ_SIZE = 64 * 1024;
+
+void ParquetFile::initialize() {
+	auto file_size = source->size();
+	if (file_size < 12) {
+		throw runtime_error("File too small to be a Parquet file");
+	}
+
+	// fetch the start magic bytes and the tail of the file together
+	auto tail_len = std::min(file_size, FOOTER_READ_SIZE);
+	ByteBuffer head, tail;
+	head.resize(4);
+	tail.resize(tail_len);
+	vector<ReadRange> ranges = { { 0, 4, head.ptr }, { file_size - tail_len,
+			tail_len, tail.ptr } };
+	source->read_ranges(ranges);
 
-	buf.resize(4);
-	memset(buf.ptr, '\0', 4);
 	// check for magic bytes at start of file
-	pfile.read(buf.ptr, 4);
-	if (strncmp(buf.ptr, "PAR1", 4) != 0) {
+	if (strncmp(head.ptr, "PAR1", 4) != 0) {
 		throw runtime_error("File not found or missing magic bytes");
 	}
 
 	// check for magic bytes at end of file
-	pfile.seekg(-4, ios_base::end);
-	pfile.read(buf.ptr, 4);
-	if (strncmp(buf.ptr, "PAR1", 4) != 0) {
+	auto tail_end = tail.ptr + tail_len;
+	if (strncmp(tail_end - 4, "PAR1", 4) != 0) {
 		throw runtime_error("No magic bytes found at end of file");
 	}
 
 	// read four-byte footer length from just before the end magic bytes
-	pfile.seekg(-8, ios_base::end);
-	pfile.read(buf.ptr, 4);
-	int32_t footer_len = *(uint32_t*) buf.ptr;
-	if (footer_len == 0) {
-		throw runtime_error("Footer length can't be 0");
+	int32_t footer_len;
+	memcpy(&footer_len, tail_end - 8, sizeof(footer_len));
+	if (footer_len <= 0 || (uint64_t) footer_len > file_size - 12) {
+		throw runtime_error("Invalid footer length");
 	}
 
-	// read footer into buffer and de-thrift
-	buf.resize(footer_len);
-	pfile.seekg(-(footer_len + 8), ios_base::end);
-	pfile.read(buf.ptr, footer_len);
-	if (!pfile) {
-		throw runtime_error("Could not read footer");
+	// read the rest of the footer if it did not fit, then de-thrift
+	ByteBuffer buf;
+	const char *footer_ptr = tail_end - 8 - footer_len;
+	if ((uint64_t) footer_len + 8 > tail_len) {
+		buf.resize(footer_len);
+		source->read(file_size - (footer_len + 8), footer_len, buf.ptr);
+		footer_ptr = buf.ptr;
 	}
 
-	thrift_unpack((const uint8_t*) buf.ptr, (uint32_t*) &footer_len,
+	thrift_unpack((const uint8_t*) footer_ptr, (uint32_t*) &footer_len,
 			&file_meta_data);
 
 //	file_meta_data.printTo(cerr);
@@ -338,6 +620,18 @@ private:
 	uint32_t BitUnpack(T *dest, uint32_t count) {
 		assert(bit_width_ < 32);
 
+		// dictionary indices and definition levels, the common cases, have vector versions
+		if (sizeof(T) == sizeof(uint32_t)) {
+			simd::kernels().unpack32(buffer, bit_width_, count, (uint32_t*) dest);
+			buffer += bit_width_ * count / 8;
+			return count;
+		}
+		if (sizeof(T) == sizeof(uint8_t) && bit_width_ == 1) {
+			simd::kernels().unpack_bits(buffer, count, (uint8_t*) dest);
+			buffer += bit_width_ * count / 8;
+			return count;
+		}
+
 		int8_t bitpack_pos = 0;
 		auto source = buffer;
 		auto mask = BITPACK_MASKS[bit_width_];
@@ -377,12 +671,16 @@ public:
 
 	uint64_t page_buf_len = 0;
 	uint64_t page_start_row = 0;
+	uint64_t num_rows = 0;
 
 	uint8_t *defined_ptr;
 
 	// for FIXED_LEN_BYTE_ARRAY
 	int32_t type_len;
 
+	// for BYTE_ARRAY, where the current dictionary starts in ResultColumn::dictionary
+	uint64_t dict_index_base = 0;
+
 	template<class T>
 	void fill_dict() {
 		auto dict_size = page_header.dictionary_page_header.num_values;
@@ -468,6 +766,11 @@ public:
 				str_ptr += str_len + 1;
 				page_buf_ptr += str_len;
 			}
+			// a second dictionary page would be out of spec, its indices go after the first one's
+			dict_index_base = result_col.dictionary.size();
+			result_col.dictionary.insert(result_col.dictionary.end(),
+					((Dictionary<char*>*) dict)->dict.begin(),
+					((Dictionary<char*>*) dict)->dict.end());
 
 			break;
 		}
@@ -489,6 +792,9 @@ public:
 		}
 
 		auto num_values = page_header.data_page_header.num_values;
+		if (num_values < 0 || page_start_row + num_values > num_rows) {
+			throw runtime_error("Page has more values than its row group");
+		}
 
 		// we have to first decode the define levels
 		switch (page_header.data_page_header.definition_level_encoding) {
@@ -546,31 +852,27 @@ public:
 	}
 
 	void scan_data_page_plain(ResultColumn &result_col) {
-		// TODO compute null count while getting the def levels already?
-		uint32_t null_count = 0;
-		for (uint32_t i = 0; i < page_header.data_page_header.num_values; i++) {
-			if (!defined_ptr[i]) {
-				null_count++;
-			}
-		}
-
 		switch (result_col.col->type) {
 		case Type::BOOLEAN: {
-			// uargh, but unfortunately neccessary because sometimes bool values are > 1
+			// bit-packed, one bit per defined value starting with the least significant one
 			bool *result_arr = (bool*) result_col.data.ptr;
-			for (int32_t val_offset = 0;
-					val_offset < page_header.data_page_header.num_values;
-					val_offset++) {
-
+			auto num_values = page_header.data_page_header.num_values;
+			auto num_defined = num_values
+					- simd::kernels().count_zeros(defined_ptr, num_values);
+			if (page_buf_ptr + (num_defined + 7) / 8 > page_buf_end_ptr) {
+				throw runtime_error("Boolean values exceed payload size");
+			}
+			auto bits = (const uint8_t*) page_buf_ptr;
+			uint64_t bit_idx = 0;
+			for (int32_t val_offset = 0; val_offset < num_values; val_offset++) {
 				if (!defined_ptr[val_offset]) {
 					continue;
 				}
-
-				auto row_idx = page_start_row + val_offset;
-				result_arr[row_idx] = ((bool*) page_buf_ptr != 0);
-				page_buf_ptr += sizeof(bool);
+				result_arr[page_start_row + val_offset] = (bits[bit_idx / 8]
+						>> (bit_idx % 8)) & 1;
+				bit_idx++;
 			}
-
+			page_buf_ptr += (num_defined + 7) / 8;
 		}
 			break;
 		case Type::INT32:
@@ -646,6 +948,29 @@ public:
 	template<class T> void fill_values_dict(ResultColumn &result_col,
 			uint32_t *offsets) {
 		auto result_arr = (T*) result_col.data.ptr;
+		auto &values = ((Dictionary<T>*) dict)->dict;
+		auto num_values = page_header.data_page_header.num_values;
+		bool in_bounds = true;
+		// undefined rows are set to zero by the gathers
+		if (sizeof(T) == sizeof(uint32_t)) {
+			in_bounds = simd::kernels().gather32((uint32_t*) values.data(),
+					values.size(), offsets, defined_ptr, num_values,
+					(uint32_t*) (result_arr + page_start_row));
+		} else if (sizeof(T) == sizeof(uint64_t)) {
+			in_bounds = simd::kernels().gather64((uint64_t*) values.data(),
+					values.size(), offsets, defined_ptr, num_values,
+					(uint64_t*) (result_arr + page_start_row));
+		} else {
+			fill_values_dict_scalar<T>(result_col, offsets);
+		}
+		if (!in_bounds) {
+			throw runtime_error("Dictionary offset out of bounds");
+		}
+	}
+
+	template<class T> void fill_values_dict_scalar(ResultColumn &result_col,
+			uint32_t *offsets) {
+		auto result_arr = (T*) result_col.data.ptr;
 		for (int32_t val_offset = 0;
 				val_offset < page_header.data_page_header.num_values;
 				val_offset++) {
@@ -678,12 +1003,8 @@ public:
 			RleBpDecoder dec((const uint8_t*) page_buf_ptr, page_buf_len,
 					enc_length);
 
-			uint32_t null_count = 0;
-			for (uint32_t i = 0; i < num_values; i++) {
-				if (!defined_ptr[i]) {
-					null_count++;
-				}
-			}
+			uint32_t null_count = simd::kernels().count_zeros(defined_ptr,
+					num_values);
 			if (null_count > 0) {
 				dec.GetBatchSpaced<uint32_t>(num_values, null_count,
 						defined_ptr, offsets.get());
@@ -723,16 +1044,14 @@ public:
 			break;
 
 		case Type::BYTE_ARRAY: {
-			auto result_arr = (char**) result_col.data.ptr;
-			for (int32_t val_offset = 0;
-					val_offset < page_header.data_page_header.num_values;
-					val_offset++) {
+			// undefined rows become nullptr
+			fill_values_dict<char*>(result_col, offsets.get());
+			auto dict_indices = (uint32_t*) result_col.dict_indices.ptr
+					+ page_start_row;
+			for (int32_t val_offset = 0; val_offset < num_values; val_offset++) {
 				if (defined_ptr[val_offset]) {
-					result_arr[page_start_row + val_offset] =
-							((Dictionary<char*>*) dict)->get(
-									offsets[val_offset]);
-				} else {
-					result_arr[page_start_row + val_offset] = nullptr;
+					dict_indices[val_offset] = dict_index_base
+							+ offsets[val_offset];
 				}
 			}
 			break;
@@ -779,7 +1098,8 @@ public:
 
 };
 
-void ParquetFile::scan_column(ScanState &state, ResultColumn &result_col) {
+void ParquetFile::scan_column(ScanState &state, ResultColumn &result_col,
+		const char *chunk_ptr) {
 	// we now expect a sequence of data pages in the buffer
 
 	auto &row_group = file_meta_data.row_groups[state.row_group_idx];
@@ -797,24 +1117,8 @@ void ParquetFile::scan_column(ScanState &state, ResultColumn &result_col) {
 		throw runtime_error("Only flat tables are supported (no nesting)");
 	}
 
-	// ugh. sometimes there is an extra offset for the dict. sometimes it's wrong.
-	auto chunk_start = chunk.meta_data.data_page_offset;
-	if (chunk.meta_data.__isset.dictionary_page_offset
-			&& chunk.meta_data.dictionary_page_offset >= 4) {
-		// this assumes the data pages follow the dict pages directly.
-		chunk_start = chunk.meta_data.dictionary_page_offset;
-	}
-	auto chunk_len = chunk.meta_data.total_compressed_size;
-
-	// read entire chunk into RAM
-	pfile.seekg(chunk_start);
-	ByteBuffer chunk_buf;
-	chunk_buf.resize(chunk_len);
-
-	pfile.read(chunk_buf.ptr, chunk_len);
-	if (!pfile) {
-		throw runtime_error("Could not read chunk. File corrupt?");
-	}
+	uint64_t chunk_start, chunk_len;
+	chunk_range(state.row_group_idx, result_col.id, chunk_start, chunk_len);
 
 	// now we have whole chunk in buffer, proceed to read pages
 	ColumnScan cs;
@@ -826,78 +1130,186 @@ void ParquetFile::scan_column(ScanState &state, ResultColumn &result_col) {
 	}
 
 	cs.page_start_row = 0;
+	cs.num_rows = row_group.num_rows;
 	cs.defined_ptr = (uint8_t*) result_col.defined.ptr;
 
-	while (bytes_to_read > 0) {
-		auto page_header_len = bytes_to_read; // the header is clearly not that long but we have no idea
-
-		// this is the only other place where we actually unpack a thrift object
-		cs.page_header = PageHeader();
-		thrift_unpack((const uint8_t*) chunk_buf.ptr,
-				(uint32_t*) &page_header_len, &cs.page_header);
+	// errors are reported with the location of the page that caused them
+	uint64_t page_offset = chunk_start;
+	// decompressed pages go here, it only grows so after the first page we usually do not allocate
+	ByteBuffer decompressed_buf;
+	try {
+		while (bytes_to_read > 0) {
+			page_offset = chunk_start + (chunk_len - bytes_to_read);
+			auto page_header_len = bytes_to_read; // the header is clearly not that long but we have no idea
+
+			// this is the only other place where we actually unpack a thrift object
+			cs.page_header = PageHeader();
+			thrift_unpack((const uint8_t*) chunk_ptr,
+					(uint32_t*) &page_header_len, &cs.page_header);
 //
-//		cs.page_header.printTo(cerr);
-//		cerr << "\n";
+//			cs.page_header.printTo(cerr);
+//			cerr << "\n";
 
-		// compressed_page_size does not include the header size
-		chunk_buf.ptr += page_header_len;
-		bytes_to_read -= page_header_len;
+			// compressed_page_size does not include the header size
+			chunk_ptr += page_header_len;
+			bytes_to_read -= page_header_len;
 
-		auto payload_end_ptr = chunk_buf.ptr
-				+ cs.page_header.compressed_page_size;
+			if (cs.page_header.compressed_page_size < 0
+					|| (uint64_t) cs.page_header.compressed_page_size
+							> bytes_to_read) {
+				throw runtime_error(
+						"Page size exceeds column chunk size. File corrupt?");
+			}
+			auto payload_end_ptr = chunk_ptr
+					+ cs.page_header.compressed_page_size;
+
+			// checksum covers the page as stored, verify right before the decompressor reads the same bytes
+			if (state.verify_crc && cs.page_header.__isset.crc
+					&& crc32(chunk_ptr, cs.page_header.compressed_page_size)
+							!= (uint32_t) cs.page_header.crc) {
+				throw runtime_error("Page checksum mismatch. File corrupt?");
+			}
 
-		ByteBuffer decompressed_buf;
+			if (chunk.meta_data.codec == CompressionCodec::UNCOMPRESSED) {
+				cs.page_buf_ptr = chunk_ptr;
+				cs.page_buf_len = cs.page_header.compressed_page_size;
+			} else {
+				auto codec = get_codec(chunk.meta_data.codec);
+				if (!codec) {
+					std::stringstream ss;
+					ss << "Unsupported compression codec " << chunk.meta_data.codec;
+					throw runtime_error(ss.str());
+				}
+				if (cs.page_header.uncompressed_page_size < 0
+						|| codec->uncompressed_length(chunk_ptr,
+								cs.page_header.compressed_page_size,
+								cs.page_header.uncompressed_page_size)
+								!= (uint64_t) cs.page_header.uncompressed_page_size) {
+					throw runtime_error("Decompressed page size mismatch");
+				}
+				decompressed_buf.resize(cs.page_header.uncompressed_page_size + 1,
+						false);
+				codec->decompress(chunk_ptr, cs.page_header.compressed_page_size,
+						decompressed_buf.ptr, cs.page_header.uncompressed_page_size);
 
-		switch (chunk.meta_data.codec) {
-		case CompressionCodec::UNCOMPRESSED:
-			cs.page_buf_ptr = chunk_buf.ptr;
-			cs.page_buf_len = cs.page_header.compressed_page_size;
+				cs.page_buf_ptr = (char*) decompressed_buf.ptr;
+				cs.page_buf_len = cs.page_header.uncompressed_page_size;
+			}
 
-			break;
-		case CompressionCodec::SNAPPY: {
-			size_t decompressed_size;
-			snappy::GetUncompressedLength(chunk_buf.ptr,
-					cs.page_header.compressed_page_size, &decompressed_size);
-			decompressed_buf.resize(decompressed_size + 1);
+			cs.page_buf_end_ptr = cs.page_buf_ptr + cs.page_buf_len;
 
-			auto res = snappy::RawUncompress(chunk_buf.ptr,
-					cs.page_header.compressed_page_size, decompressed_buf.ptr);
-			if (!res) {
-				throw runtime_error("Decompression failure");
+			switch (cs.page_header.type) {
+			case PageType::DICTIONARY_PAGE:
+				cs.scan_dict_page(result_col);
+				break;
+
+			case PageType::DATA_PAGE: {
+				cs.scan_data_page(result_col);
+				break;
 			}
+			case PageType::DATA_PAGE_V2:
+				throw runtime_error("v2 data page format is not supported");
 
-			cs.page_buf_ptr = (char*) decompressed_buf.ptr;
-			cs.page_buf_len = cs.page_header.uncompressed_page_size;
+			default:
+				break; // ignore INDEX page type and any other custom extensions
+			}
 
-			break;
+			chunk_ptr = payload_end_ptr;
+			bytes_to_read -= cs.page_header.compressed_page_size;
 		}
-		default:
-			throw runtime_error(
-					"Unsupported compression codec. Try uncompressed or snappy");
+		if (cs.page_start_row != cs.num_rows) {
+			throw runtime_error("Column chunk has fewer values than its row group");
 		}
+	} catch (std::exception &e) {
+		try {
+			cs.cleanup(result_col);
+		} catch (...) {
+		}
+		std::stringstream ss;
+		ss << "Column " << result_col.col->name << ", row group "
+				<< state.row_group_idx << ", page at offset " << page_offset
+				<< ": " << e.what();
+		throw runtime_error(ss.str());
+	}
+	cs.cleanup(result_col);
 
-		cs.page_buf_end_ptr = cs.page_buf_ptr + cs.page_buf_len;
+	if (state.readahead) {
+		source->dont_need(chunk_start, chunk_len);
+	}
+}
 
-		switch (cs.page_header.type) {
-		case PageType::DICTIONARY_PAGE:
-			cs.scan_dict_page(result_col);
-			break;
+void ParquetFile::chunk_range(uint64_t row_group_idx, uint64_t col_idx,
+		uint64_t &start, uint64_t &len) {
+	auto &chunk = file_meta_data.row_groups[row_group_idx].columns[col_idx];
 
-		case PageType::DATA_PAGE: {
-			cs.scan_data_page(result_col);
-			break;
-		}
-		case PageType::DATA_PAGE_V2:
-			throw runtime_error("v2 data page format is not supported");
+	// ugh. sometimes there is an extra offset for the dict. sometimes it's wrong.
+	start = chunk.meta_data.data_page_offset;
+	if (chunk.meta_data.__isset.dictionary_page_offset
+			&& chunk.meta_data.dictionary_page_offset >= 4) {
+		// this assumes the data pages follow the dict pages directly.
+		start = chunk.meta_data.dictionary_page_offset;
+	}
+	len = chunk.meta_data.total_compressed_size;
+}
 
-		default:
-			break; // ignore INDEX page type and any other custom extensions
+bool ParquetFile::chunk_min_max(uint64_t row_group_idx, uint64_t col_idx,
+		std::string &min, std::string &max) const {
+	if (row_group_idx >= file_meta_data.row_groups.size()
+			|| col_idx >= columns.size()) {
+		throw runtime_error("Row group or column index out of range");
+	}
+	auto &meta_data =
+			file_meta_data.row_groups[row_group_idx].columns[col_idx].meta_data;
+	if (!meta_data.__isset.statistics) {
+		return false;
+	}
+	auto &stats = meta_data.statistics;
+	if (stats.__isset.min_value && stats.__isset.max_value) {
+		min = stats.min_value;
+		max = stats.max_value;
+		return true;
+	}
+	// the deprecated fields were written with signed byte comparison, so they are
+	// only right for numbers
+	switch (columns[col_idx]->type) {
+	case Type::INT32:
+	case Type::INT64:
+	case Type::FLOAT:
+	case Type::DOUBLE:
+		if (stats.__isset.min && stats.__isset.max) {
+			min = stats.min;
+			max = stats.max;
+			return true;
 		}
+		return false;
+	default:
+		return false;
+	}
+}
 
-		chunk_buf.ptr = payload_end_ptr;
-		bytes_to_read -= cs.page_header.compressed_page_size;
+// tell the source we are about to read the projected chunks of a row group
+void ParquetFile::prefetch_row_group(uint64_t row_group_idx,
+		ResultChunk &result) {
+	if (row_group_idx >= file_meta_data.row_groups.size()) {
+		return;
+	}
+	// chunks of neighbouring columns are usually adjacent, merge them into one hint
+	uint64_t range_start = 0, range_end = 0;
+	for (auto &result_col : result.cols) {
+		uint64_t chunk_start, chunk_len;
+		chunk_range(row_group_idx, result_col.id, chunk_start, chunk_len);
+		if (chunk_start != range_end) {
+			if (range_end > range_start) {
+				source->will_need(range_start, range_end - range_start);
+			}
+			range_start = chunk_start;
+			range_end = chunk_start;
+		}
+		range_end += chunk_len;
+	}
+	if (range_end > range_start) {
+		source->will_need(range_start, range_end - range_start);
 	}
-	cs.cleanup(result_col);
 }
 
 void ParquetFile::initialize_column(ResultColumn &col, uint64_t num_rows) {
@@ -928,6 +1340,10 @@ void ParquetFile::initialize_column(ResultColumn &col, uint64_t num_rows) {
 		break;
 	case Type::BYTE_ARRAY:
 		col.data.resize(sizeof(char*) * num_rows, false);
+		// NO_DICT_INDEX is all ones
+		col.dict_indices.resize(sizeof(uint32_t) * num_rows, false);
+		memset(col.dict_indices.ptr, 0xFF, sizeof(uint32_t) * num_rows);
+		col.dictionary.clear();
 		break;
 
 	case Type::FIXED_LEN_BYTE_ARRAY: {
@@ -946,6 +1362,42 @@ void ParquetFile::initialize_column(ResultColumn &col, uint64_t num_rows) {
 	}
 }
 
+static uint64_t value_width(Type::type type) {
+	switch (type) {
+	case Type::BOOLEAN:
+		return sizeof(bool);
+	case Type::INT32:
+	case Type::FLOAT:
+		return sizeof(int32_t);
+	case Type::INT64:
+	case Type::DOUBLE:
+		return sizeof(int64_t);
+	case Type::INT96:
+		return sizeof(Int96);
+	default:
+		return 0;
+	}
+}
+
+// writes the column's null_value to all NULL rows
+static void fill_nulls(ResultColumn &col, uint64_t num_rows) {
+	auto width = value_width(col.col->type);
+	if (width == 0 || col.null_value.size() != width) {
+		throw runtime_error(
+				"Null value for column " + col.col->name + " needs "
+						+ to_string(width) + " bytes");
+	}
+	auto defined = (const uint8_t*) col.defined.ptr;
+	if (simd::kernels().count_zeros(defined, num_rows) == 0) {
+		return;
+	}
+	for (uint64_t row_idx = 0; row_idx < num_rows; row_idx++) {
+		if (!defined[row_idx]) {
+			memcpy(col.data.ptr + row_idx * width, col.null_value.data(), width);
+		}
+	}
+}
+
 bool ParquetFile::scan(ScanState &s, ResultChunk &result) {
 	if (s.row_group_idx >= file_meta_data.row_groups.size()) {
 		result.nrows = 0;
@@ -955,15 +1407,57 @@ bool ParquetFile::scan(ScanState &s, ResultChunk &result) {
 	auto &row_group = file_meta_data.row_groups[s.row_group_idx];
 	result.nrows = row_group.num_rows;
 
-	for (auto &result_col : result.cols) {
-		initialize_column(result_col, row_group.num_rows);
-		scan_column(s, result_col);
+	if (s.readahead) {
+		// keep one row group ahead of the decoder
+		s.readahead_idx = std::max(s.readahead_idx, s.row_group_idx);
+		while (s.readahead_idx <= s.row_group_idx + 1) {
+			prefetch_row_group(s.readahead_idx++, result);
+		}
+	}
+
+	// get all projected chunks of this row group in one go, this allows remote
+	// sources to coalesce them into few parallel requests. Memory-resident sources are not copied.
+	vector<ByteBuffer> chunk_bufs(result.cols.size());
+	vector<const char*> chunk_ptrs(result.cols.size());
+	vector<ReadRange> ranges;
+	for (size_t i = 0; i < result.cols.size(); i++) {
+		uint64_t chunk_start, chunk_len;
+		chunk_range(s.row_group_idx, result.cols[i].id, chunk_start, chunk_len);
+		chunk_ptrs[i] = source->view(chunk_start, chunk_len);
+		if (!chunk_ptrs[i]) {
+			chunk_bufs[i].resize(chunk_len);
+			chunk_ptrs[i] = chunk_bufs[i].ptr;
+			ranges.push_back( { chunk_start, chunk_len, chunk_bufs[i].ptr });
+		}
+	}
+	source->read_ranges(ranges);
+
+	for (size_t i = 0; i < result.cols.size(); i++) {
+		initialize_column(result.cols[i], row_group.num_rows);
+		scan_column(s, result.cols[i], chunk_ptrs[i]);
+		if (!result.cols[i].null_value.empty()) {
+			fill_nulls(result.cols[i], row_group.num_rows);
+		}
 	}
 
 	s.row_group_idx++;
 	return true;
 }
 
+void ParquetFile::initialize_result(ResultChunk &result,
+		std::vector<uint64_t> column_ids) {
+	result.nrows = 0;
+	result.cols.clear();
+	result.cols.resize(column_ids.size());
+	for (size_t i = 0; i < column_ids.size(); i++) {
+		if (column_ids[i] >= columns.size()) {
+			throw runtime_error("Column index out of range");
+		}
+		result.cols[i].col = columns[column_ids[i]].get();
+		result.cols[i].id = column_ids[i];
+	}
+}
+
 void ParquetFile::initialize_result(ResultChunk &result) {
 	result.nrows = 0;
 	result.cols.resize(columns.size());
@@ -4,9 +4,18 @@
 #include <vector>
 #include <bitset>
 #include <fstream>
+#include <memory>
+#include <mutex>
+#include <functional>
 #include <cstring>
+#include <cstdint>
 #include "parquet/parquet_types.h"
 
+// Arrow C data interface, see arrow/abi.h
+struct ArrowSchema;
+struct ArrowArray;
+struct ArrowArrayStream;
+
 namespace miniparquet {
 
 class ParquetColumn {
@@ -43,6 +52,22 @@ public:
 	char* ptr = nullptr;
 	uint64_t len = 0;
 
+	ByteBuffer() = default;
+	// moving hands over the memory and leaves an empty buffer behind
+	ByteBuffer(ByteBuffer &&other) noexcept :
+			ptr(other.ptr), len(other.len), holder(std::move(other.holder)) {
+		other.ptr = nullptr;
+		other.len = 0;
+	}
+	ByteBuffer& operator=(ByteBuffer &&other) noexcept {
+		ptr = other.ptr;
+		len = other.len;
+		holder = std::move(other.holder);
+		other.ptr = nullptr;
+		other.len = 0;
+		return *this;
+	}
+
 	void resize(uint64_t new_size, bool copy=true) {
 		if (new_size > len) {
 			auto new_holder = std::unique_ptr<char[]>(new char[new_size]);
@@ -54,6 +79,13 @@ public:
 			len = new_size;
 		}
 	}
+	// points the buffer at memory owned by someone else, e.g. a NumPy array. Scans that
+	// need at most external_len bytes then decode straight into it.
+	void wrap(char *external, uint64_t external_len) {
+		holder.reset();
+		ptr = external;
+		len = external_len;
+	}
 private:
 	std::unique_ptr<char[]> holder = nullptr;
 };
@@ -62,6 +94,126 @@ class ScanState {
 public:
 	uint64_t row_group_idx = 0;
 	uint64_t row_group_offset = 0;
+	// tell the OS which chunks we are about to read and which ones we are done with
+	bool readahead = false;
+	uint64_t readahead_idx = 0; // first row group we have not announced yet
+	// check page checksums where the writer stored them
+	bool verify_crc = false;
+};
+
+struct ReadRange {
+	uint64_t offset;
+	uint64_t len;
+	char *dest;
+};
+
+// where the bytes of a Parquet file come from. Implement this to read from your own storage,
+// read() may be called from several threads at once.
+class ParquetSource {
+public:
+	virtual ~ParquetSource() {
+	}
+	virtual uint64_t size() = 0;
+	// reads exactly len bytes at offset into dest, throws otherwise
+	virtual void read(uint64_t offset, uint64_t len, char *dest) = 0;
+	// reads a batch of ranges, sources with expensive round trips should override this
+	virtual void read_ranges(std::vector<ReadRange> &ranges);
+	// pointer to len bytes at offset if the source is memory-resident, nullptr otherwise
+	virtual const char* view(uint64_t offset, uint64_t len) {
+		return nullptr;
+	}
+	// access pattern hints, sources that cannot use them ignore them
+	virtual void will_need(uint64_t offset, uint64_t len) {
+	}
+	virtual void dont_need(uint64_t offset, uint64_t len) {
+	}
+};
+
+class FileSource: public ParquetSource {
+public:
+	FileSource(std::string filename);
+	// takes ownership of an open file descriptor
+	FileSource(int fd);
+	~FileSource();
+	uint64_t size() override;
+	void read(uint64_t offset, uint64_t len, char *dest) override;
+	void will_need(uint64_t offset, uint64_t len) override;
+	void dont_need(uint64_t offset, uint64_t len) override;
+
+private:
+	int fd = -1;
+	uint64_t file_size = 0;
+};
+
+// a Parquet file that is already in memory, the memory is not copied and must outlive the source
+class MemorySource: public ParquetSource {
+public:
+	MemorySource(const char *ptr, uint64_t len);
+	uint64_t size() override;
+	void read(uint64_t offset, uint64_t len, char *dest) override;
+	const char* view(uint64_t offset, uint64_t len) override;
+
+protected:
+	MemorySource() {
+	}
+	const char *ptr = nullptr;
+	uint64_t len = 0;
+};
+
+class MmapSource: public MemorySource {
+public:
+	MmapSource(std::string filename);
+	~MmapSource();
+	void will_need(uint64_t offset, uint64_t len) override;
+	void dont_need(uint64_t offset, uint64_t len) override;
+
+private:
+	void advise(uint64_t offset, uint64_t len, int advice);
+};
+
+// reads a non-seekable stream such as stdin or a pipe to its end. Streams up to memory_limit bytes
+// are kept in memory, larger ones are spilled to a temporary file. The footer is at the end of the
+// file, so decoding can only start once the stream is exhausted.
+class StreamSource: public ParquetSource {
+public:
+	StreamSource(int fd, uint64_t memory_limit = 256 * 1024 * 1024);
+	uint64_t size() override;
+	void read(uint64_t offset, uint64_t len, char *dest) override;
+	const char* view(uint64_t offset, uint64_t len) override;
+	void will_need(uint64_t offset, uint64_t len) override;
+	void dont_need(uint64_t offset, uint64_t len) override;
+
+private:
+	ByteBuffer buffer;
+	std::unique_ptr<ParquetSource> spooled;
+};
+
+// reads from a plain http:// URL. Footer and magic bytes are fetched with a single round trip, row group
+// chunks with parallel requests. From servers without range requests the whole file is downloaded once.
+class HttpSource: public ParquetSource {
+public:
+	HttpSource(std::string url);
+	~HttpSource();
+	uint64_t size() override;
+	void read(uint64_t offset, uint64_t len, char *dest) override;
+	void read_ranges(std::vector<ReadRange> &ranges) override;
+
+	// ranges that are closer together than this are fetched with a single request
+	uint64_t coalesce_gap = 1024 * 1024;
+	uint32_t max_connections = 8;
+
+private:
+	int get(std::string range, std::string &body, std::string &content_range,
+			std::function<void(int)> on_status = nullptr);
+	bool read_cached(uint64_t offset, uint64_t len, char *dest);
+	int connect_socket();
+	std::string host, port, path;
+	uint64_t file_size = 0;
+	// speculatively fetched blocks, offset and contents
+	std::vector<std::pair<uint64_t, std::string>> cached;
+	// idle keep-alive connections
+	std::vector<int> idle;
+	std::mutex idle_lock;
 };
 
 struct ResultColumn {
@@ -71,6 +223,16 @@ struct ResultColumn {
 	ByteBuffer defined;
 	std::vector<std::unique_ptr<char[]>> string_heap_chunks;
 
+	// if set, NULL rows of BOOLEAN, INT32, INT64, INT96, FLOAT and DOUBLE columns get this value, e.g. NA
+	// when data is wrapped around R vectors. Has to be as wide as a value. Otherwise NULL rows are undefined.
+	std::string null_value;
+
+	// BYTE_ARRAY columns only: the dictionary of the chunk and, as uint32_t, the index of every row in it.
+	// Rows that are NULL or come from pages without dictionary encoding have NO_DICT_INDEX. Rows with the
+	// same index share their string, so per-value work like creating string objects can be cached.
+	std::vector<char*> dictionary;
+	ByteBuffer dict_indices;
+	static constexpr uint32_t NO_DICT_INDEX = UINT32_MAX;
 };
 
 struct ResultChunk {
@@ -78,20 +240,78 @@ struct ResultChunk {
 	uint64_t nrows;
 };
 
+// page decompressor. Every thread gets its own instance of a codec, so implementations can keep
+// state like decompression contexts between pages without locking.
+class Codec {
+public:
+	virtual ~Codec() {
+	}
+	// uncompressed size of a page for formats that store it, expected is what the page header says
+	virtual uint64_t uncompressed_length(const char *src, uint64_t src_len,
+			uint64_t expected) {
+		return expected;
+	}
+	// decompresses src into exactly dst_len bytes at dst, throws if that does not work out
+	virtual void decompress(const char *src, uint64_t src_len, char *dst,
+			uint64_t dst_len) = 0;
+};
+
+typedef std::function<std::unique_ptr<Codec>()> CodecFactory;
+
+// makes the reader use factory for pages compressed with codec, replacing a built-in or previously
+// registered codec. Snappy, GZIP, ZSTD, LZ4 and LZ4_RAW are built in.
+void register_codec(parquet::format::CompressionCodec::type codec,
+		CodecFactory factory);
+
+// the calling thread's instance of codec, nullptr if there is none
+Codec* get_codec(parquet::format::CompressionCodec::type codec);
+
+enum class FileAccess {
+	READ, MMAP
+};
+
 class ParquetFile {
 public:
-	ParquetFile(std::string filename);
+	// filename can also be a http:// URL or - for standard input
+	ParquetFile(std::string filename, FileAccess access = FileAccess::READ);
+	// reads from memory without copying it, the buffer has to outlive the ParquetFile
+	ParquetFile(const char *buf, uint64_t len);
+	ParquetFile(std::unique_ptr<ParquetSource> source);
 	void initialize_result(ResultChunk& result);
+	// only scan the given columns, in this order
+	void initialize_result(ResultChunk& result, std::vector<uint64_t> column_ids);
 	bool scan(ScanState &s, ResultChunk& result);
 	uint64_t nrow;
 	std::vector<std::unique_ptr<ParquetColumn>> columns;
+	const parquet::format::FileMetaData& meta_data() const {
+		return file_meta_data;
+	}
+	// the PLAIN encoded minimum and maximum of a column chunk from its statistics, e.g. to skip
+	// row groups. Returns false if the writer did not store usable statistics.
+	bool chunk_min_max(uint64_t row_group_idx, uint64_t col_idx,
+			std::string &min, std::string &max) const;
 
 private:
-	void initialize(std::string filename);
+	void initialize();
 	void initialize_column(ResultColumn& col, uint64_t num_rows);
-	void scan_column(ScanState& state, ResultColumn& result_col);
+	void scan_column(ScanState& state, ResultColumn& result_col, const char *chunk_ptr);
+	void chunk_range(uint64_t row_group_idx, uint64_t col_idx, uint64_t& start, uint64_t& len);
+	void prefetch_row_group(uint64_t row_group_idx, ResultChunk& result);
 	parquet::format::FileMetaData file_meta_data;
-	std::ifstream pfile;
+	std::unique_ptr<ParquetSource> source;
 };
 
+// Arrow C data interface export. The schema is a struct with one field per column of result,
+// it only needs initialize_result() to have been called.
+void export_arrow_schema(const ResultChunk &result, ArrowSchema *out);
+
+// hands a scanned chunk over as a struct array matching export_arrow_schema(). Integer and
+// floating point columns are passed on without copying, so the chunk gives up their buffers and
+// the next scan allocates new ones. This needs buffers owned by the chunk, not wrapped ones.
+void export_arrow_array(ResultChunk &result, ArrowArray *out);
+
+// a stream of one struct array per row group of file, with the given columns
+void export_arrow_stream(std::shared_ptr<ParquetFile> file,
+		std::vector<uint64_t> column_ids, ArrowArrayStream *out);
+
 }
@@ -0,0 +1,85 @@
+// C interface of miniparquet, for use through FFI from other languages. Handles are opaque, errors are
+// status codes and no exceptions cross it. Functions on different handles may run on different threads,
+// a handle must not be used by two threads at once.
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+	MP_OK = 0,
+	// the file could not be opened, read or decoded
+	MP_ERROR = 1,
+	MP_INVALID_ARGUMENT = 2,
+	// a string does not fit into the values buffer of a batch that is still empty
+	MP_BUFFER_TOO_SMALL = 3,
+	MP_OUT_OF_MEMORY = 4
+} mp_status;
+
+// physical types, the values of the Parquet Type enum
+typedef enum {
+	MP_BOOLEAN = 0,
+	MP_INT32 = 1,
+	MP_INT64 = 2,
+	MP_INT96 = 3,
+	MP_FLOAT = 4,
+	MP_DOUBLE = 5,
+	MP_BYTE_ARRAY = 6,
+	MP_FIXED_LEN_BYTE_ARRAY = 7
+} mp_type;
+
+typedef struct mp_file mp_file;
+
+typedef struct {
+	const char *name;
+	mp_type type;
+	// bytes per value in batches, 0 for BYTE_ARRAY
+	int32_t width;
+	// the Parquet ConvertedType, e.g. 0 for UTF8 or 5 for DECIMAL, -1 if there is none
+	int32_t converted_type;
+	// for decimals
+	int32_t precision;
+	int32_t scale;
+} mp_column;
+
+// where a batch of one column goes. Values are in their Parquet layout: BOOLEAN as one byte, INT96 as
+// 12 bytes, FIXED_LEN_BYTE_ARRAY as width bytes. BYTE_ARRAY values are concatenated in values, row i is
+// bytes offsets[i] up to offsets[i + 1]. NULL rows have defined 0, zeroed fixed-width values and no bytes.
+typedef struct {
+	// capacity rows of width bytes, or values_size bytes for BYTE_ARRAY
+	void *values;
+	uint64_t values_size;
+	// capacity + 1 entries, BYTE_ARRAY only
+	int64_t *offsets;
+	// capacity entries, may be NULL if NULLs do not matter
+	uint8_t *defined;
+} mp_buffer;
+
+// the message of the last error on this thread
+const char *mp_last_error(void);
+
+mp_status mp_open(const char *filename, mp_file **out);
+// reads from memory without copying it, the buffer has to outlive the handle
+mp_status mp_open_buffer(const void *buf, uint64_t len, mp_file **out);
+
+// all columns of the file, valid until mp_close
+mp_status mp_schema(mp_file *file, uint64_t *ncols, const mp_column **cols,
+		uint64_t *nrows);
+
+// scans only the given columns, in this order, and restarts the scan. All columns are scanned by default.
+mp_status mp_project(mp_file *file, const uint64_t *col_ids, uint64_t ncols);
+
+// decodes up to capacity rows into one buffer per projected column, nrows is 0 at the end of the file.
+// Batches end early at row group boundaries or if the strings of the next row do not fit.
+mp_status mp_scan_next_batch(mp_file *file, mp_buffer *buffers,
+		uint64_t capacity, uint64_t *nrows);
+
+void mp_close(mp_file *file);
+
+#ifdef __cplusplus
+}
+#endif
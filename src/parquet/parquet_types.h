@@ -106,7 +106,8 @@ struct CompressionCodec {
     LZO = 3,
     BROTLI = 4,
     LZ4 = 5,
-    ZSTD = 6
+    ZSTD = 6,
+    LZ4_RAW = 7
   };
 };
 
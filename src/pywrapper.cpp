@@ -5,10 +5,20 @@
 #undef error
 #undef length
 
+#define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION
+#include <numpy/arrayobject.h>
+
 #include "miniparquet.h"
+#include "arrow/abi.h"
+#include "simd/simd.h"
 
 #include <cmath>
 #include <iostream>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <functional>
+#include <algorithm>
 
 using namespace miniparquet;
 using namespace std;
@@ -34,6 +44,15 @@ struct PythonWrapperObject {
 			throw runtime_error("malloc failure");
 		}
 	}
+	PythonWrapperObject(PythonWrapperObject &&other) : obj(other.Release()) {
+	}
+	PythonWrapperObject &operator=(PythonWrapperObject &&other) {
+		if (obj) {
+			Py_DECREF(obj);
+		}
+		obj = other.Release();
+		return *this;
+	}
 	~PythonWrapperObject() {
 		if (obj) {
 			Py_DECREF(obj);
@@ -48,129 +67,1223 @@ struct PythonWrapperObject {
 	PyObject *obj;
 };
 
-static PyObject *miniparquet_read(PyObject *self, PyObject *args) {
-	const char *fname;
-	if (!PyArg_ParseTuple(args, "s", &fname)) {
+// keeps a bytes-like object pinned while we read from its memory
+struct PythonBufferWrapper {
+	PythonBufferWrapper() {
+		view.obj = nullptr;
+	}
+	~PythonBufferWrapper() {
+		if (view.obj) {
+			PyBuffer_Release(&view);
+		}
+	}
+	Py_buffer view;
+};
+
+// numpy.ma.MaskedArray, columns with NULLs are returned as masked arrays
+static PyObject *masked_array_type = nullptr;
+
+// FIXED_LEN_BYTE_ARRAY decimals are big-endian two's complement integers of any length
+static double decimal_to_double(const char *bytes, int32_t type_len, int32_t scale) {
+	double val = type_len > 0 ? (int8_t)bytes[0] : 0;
+	for (auto i = 1; i < type_len; i++) {
+		val = val * 256 + (uint8_t)bytes[i];
+	}
+	return val / pow(10.0, scale);
+}
+
+// the NumPy type a column is returned as
+static PyArray_Descr *numpy_descr(ParquetColumn &col) {
+	switch (col.type) {
+	case parquet::format::Type::BOOLEAN:
+		return PyArray_DescrFromType(NPY_BOOL);
+	case parquet::format::Type::INT32:
+		return PyArray_DescrFromType(NPY_INT32);
+	case parquet::format::Type::INT64:
+		return PyArray_DescrFromType(NPY_INT64);
+	case parquet::format::Type::FLOAT:
+		return PyArray_DescrFromType(NPY_FLOAT32);
+	case parquet::format::Type::DOUBLE:
+		return PyArray_DescrFromType(NPY_FLOAT64);
+	case parquet::format::Type::INT96: {
+		PythonWrapperObject unit(PyUnicode_FromString("M8[ns]"));
+		PyArray_Descr *descr = nullptr;
+		if (!PyArray_DescrConverter(unit.obj, &descr)) {
+			throw runtime_error("Could not create datetime64 type");
+		}
+		return descr;
+	}
+	case parquet::format::Type::FIXED_LEN_BYTE_ARRAY: {
+		auto &s_ele = col.schema_element;
+		if (!s_ele->__isset.converted_type || s_ele->converted_type != parquet::format::ConvertedType::DECIMAL) {
+			throw runtime_error("Unsupported FLBA type in column " + col.name);
+		}
+		return PyArray_DescrFromType(NPY_FLOAT64);
+	}
+	case parquet::format::Type::BYTE_ARRAY:
+		return PyArray_DescrFromType(NPY_OBJECT);
+	default:
+		throw runtime_error("Unsupported type in column " + col.name);
+	}
+}
+
+// types whose in-memory representation is the same in the scan result and in NumPy
+static bool decodes_in_place(ParquetColumn &col) {
+	switch (col.type) {
+	case parquet::format::Type::BOOLEAN:
+	case parquet::format::Type::INT32:
+	case parquet::format::Type::INT64:
+	case parquet::format::Type::FLOAT:
+	case parquet::format::Type::DOUBLE:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// a str from a UTF-8 string, ASCII is copied without decoding
+static PyObject *make_string(ParquetColumn &pcol, const char *value) {
+	auto len = strlen(value);
+	PyObject *res;
+	if (simd::kernels().is_ascii((const uint8_t *)value, len)) {
+		res = PyUnicode_New(len, 127);
+		if (res) {
+			memcpy(PyUnicode_DATA(res), value, len);
+		}
+	} else {
+		res = PyUnicode_DecodeUTF8(value, len, nullptr);
+	}
+	if (!res) {
+		// this may run on a worker thread, whose Python error would get lost
+		PyErr_Clear();
+		throw runtime_error("Invalid UTF-8 in column " + pcol.name);
+	}
+	return res;
+}
+
+// converts the rows of a scanned column that NumPy cannot take as they are, NULLs are left alone.
+// Needs the GIL for strings only.
+static void convert_rows(ParquetColumn &pcol, ResultColumn &col, uint64_t nrows, char *dest) {
+	switch (pcol.type) {
+	case parquet::format::Type::INT96: {
+		auto src = (Int96 *)col.data.ptr;
+		auto dest_arr = (int64_t *)dest;
+		for (uint64_t row_idx = 0; row_idx < nrows; row_idx++) {
+			if (col.defined.ptr[row_idx]) {
+				dest_arr[row_idx] = impala_timestamp_to_nanoseconds(src[row_idx]);
+			}
+		}
+		break;
+	}
+	case parquet::format::Type::FIXED_LEN_BYTE_ARRAY: {
+		auto &s_ele = pcol.schema_element;
+		auto src = (char **)col.data.ptr;
+		auto dest_arr = (double *)dest;
+		for (uint64_t row_idx = 0; row_idx < nrows; row_idx++) {
+			if (col.defined.ptr[row_idx]) {
+				dest_arr[row_idx] = decimal_to_double(src[row_idx], s_ele->type_length, s_ele->scale);
+			}
+		}
+		break;
+	}
+	case parquet::format::Type::BYTE_ARRAY: {
+		auto src = (char **)col.data.ptr;
+		auto dict_indices = (uint32_t *)col.dict_indices.ptr;
+		auto dest_arr = (PyObject **)dest;
+		// rows from dictionary pages share one string object per dictionary entry
+		vector<PythonWrapperObject> dict_strings(col.dictionary.size());
+		for (uint64_t row_idx = 0; row_idx < nrows; row_idx++) {
+			PyObject *item;
+			if (!col.defined.ptr[row_idx]) {
+				item = Py_None;
+				Py_INCREF(item);
+			} else if (dict_indices[row_idx] != ResultColumn::NO_DICT_INDEX) {
+				auto &cached = dict_strings[dict_indices[row_idx]];
+				if (!cached.obj) {
+					cached.obj = make_string(pcol, src[row_idx]);
+				}
+				item = cached.obj;
+				Py_INCREF(item);
+			} else {
+				item = make_string(pcol, src[row_idx]);
+			}
+			dest_arr[row_idx] = item;
+		}
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+// builds the Python object for a fully scanned column: the array itself if there are no NULLs, else a
+// masked array. mask holds the definition levels of all rows and is turned into the mask in place.
+static PyObject *finish_column(ParquetColumn &pcol, PythonWrapperObject &array, PythonWrapperObject &mask) {
+	auto arr = (PyArrayObject *)array.obj;
+	auto nrows = PyArray_SIZE(arr);
+	auto itemsize = PyArray_ITEMSIZE(arr);
+	auto data = (char *)PyArray_DATA(arr);
+	auto mask_data = (uint8_t *)PyArray_DATA((PyArrayObject *)mask.obj);
+
+	bool has_nulls = false;
+	for (npy_intp row_idx = 0; row_idx < nrows; row_idx++) {
+		mask_data[row_idx] = !mask_data[row_idx];
+		has_nulls |= mask_data[row_idx];
+	}
+	// strings are None where NULL
+	if (!has_nulls || pcol.type == parquet::format::Type::BYTE_ARRAY) {
+		return array.Release();
+	}
+	// do not leave scratch values behind the mask
+	for (npy_intp row_idx = 0; row_idx < nrows; row_idx++) {
+		if (mask_data[row_idx]) {
+			memset(data + row_idx * itemsize, 0, itemsize);
+		}
+	}
+	PythonWrapperObject args(Py_BuildValue("(O)", array.obj));
+	PythonWrapperObject kwargs(Py_BuildValue("{s:O}", "mask", mask.obj));
+	auto res = PyObject_Call(masked_array_type, args.obj, kwargs.obj);
+	if (!res) {
+		throw runtime_error("Could not create masked array");
+	}
+	return res;
+}
+
+// takes the GIL for the lifetime of the object, for threads that run with it released
+struct PythonGILGuard {
+	PythonGILGuard() : state(PyGILState_Ensure()) {
+	}
+	~PythonGILGuard() {
+		PyGILState_Release(state);
+	}
+	PyGILState_STATE state;
+};
+
+// a file to read, by name or from a bytes-like object
+struct ReadInput {
+	string fname;
+	PythonBufferWrapper buffer;
+	unique_ptr<ParquetFile> file;
+};
+
+static bool parse_input(PyObject *input, ReadInput &res) {
+	if (PyUnicode_Check(input)) {
+		auto fname_ptr = PyUnicode_AsUTF8(input);
+		if (!fname_ptr) {
+			return false;
+		}
+		res.fname = fname_ptr;
+	} else if (PyObject_CheckBuffer(input)) {
+		// bytes, bytearray, memoryview etc., read in place
+		if (PyObject_GetBuffer(input, &res.buffer.view, PyBUF_SIMPLE) != 0) {
+			return false;
+		}
+	} else {
+		PyErr_SetString(PyExc_TypeError, "Need a file name or a bytes-like object");
+		return false;
+	}
+	return true;
+}
+
+// opens the file of a parsed input, can run without the GIL
+static void open_input(ReadInput &input) {
+	if (input.buffer.view.obj) {
+		input.file =
+		    unique_ptr<ParquetFile>(new ParquetFile((const char *)input.buffer.view.buf, input.buffer.view.len));
+	} else {
+		input.file = unique_ptr<ParquetFile>(new ParquetFile(input.fname));
+	}
+}
+
+// runs task(0) ... task(n - 1) on up to threads threads, must be called without the GIL.
+// Returns the first error message, or an empty string if all tasks succeeded.
+static string parallel_for(size_t n, unsigned threads, const function<void(size_t)> &task) {
+	atomic<size_t> next_task(0);
+	atomic<bool> failed(false);
+	string error;
+	mutex error_lock;
+	auto worker = [&]() {
+		size_t task_idx;
+		while (!failed && (task_idx = next_task++) < n) {
+			try {
+				task(task_idx);
+			} catch (std::exception &ex) {
+				lock_guard<mutex> guard(error_lock);
+				if (!failed) {
+					error = ex.what();
+					failed = true;
+				}
+			}
+		}
+	};
+	vector<thread> pool;
+	for (size_t i = 1; i < min<size_t>(threads, n); i++) {
+		pool.push_back(thread(worker));
+	}
+	worker();
+	for (auto &t : pool) {
+		t.join();
+	}
+	return error;
+}
+
+// files read together need the same columns in the same order
+static bool same_column(ParquetColumn &a, ParquetColumn &b) {
+	if (a.name != b.name || a.type != b.type) {
+		return false;
+	}
+	if (a.type == parquet::format::Type::FIXED_LEN_BYTE_ARRAY) {
+		return a.schema_element->type_length == b.schema_element->type_length &&
+		       a.schema_element->scale == b.schema_element->scale;
+	}
+	return true;
+}
+
+// the NumPy arrays a set of columns is decoded into, one for the values and one for the definition
+// levels, which become the mask
+struct NumpyColumns {
+	// needs the GIL
+	NumpyColumns(vector<ParquetColumn *> columns_p, uint64_t nrows) : columns(move(columns_p)) {
+		npy_intp dims[] = {(npy_intp)nrows};
+		for (auto col : columns) {
+			arrays.push_back(PythonWrapperObject(
+			    PyArray_NewFromDescr(&PyArray_Type, numpy_descr(*col), 1, dims, nullptr, nullptr, 0, nullptr)));
+			masks.push_back(PythonWrapperObject(PyArray_SimpleNew(1, dims, NPY_BOOL)));
+		}
+	}
+
+	// scans the row group s points to into rows [dest_offset, dest_offset + nrows) of the arrays. rc has
+	// to be initialized for the same columns. Runs without the GIL, strings take it for just their creation.
+	void scan(ParquetFile &f, ScanState &s, ResultChunk &rc, uint64_t dest_offset, uint64_t nrows) {
+		// numeric values and definition levels are decoded right into the arrays
+		for (size_t col_idx = 0; col_idx < columns.size(); col_idx++) {
+			auto arr = (PyArrayObject *)arrays[col_idx].obj;
+			auto itemsize = PyArray_ITEMSIZE(arr);
+			auto &col = rc.cols[col_idx];
+			if (decodes_in_place(*col.col)) {
+				col.data.wrap((char *)PyArray_DATA(arr) + dest_offset * itemsize, nrows * itemsize);
+			}
+			col.defined.wrap((char *)PyArray_DATA((PyArrayObject *)masks[col_idx].obj) + dest_offset, nrows);
+		}
+		if (!f.scan(s, rc) || rc.nrows != nrows) {
+			throw runtime_error("Row group has an unexpected number of rows. File corrupt?");
+		}
+		for (size_t col_idx = 0; col_idx < columns.size(); col_idx++) {
+			auto arr = (PyArrayObject *)arrays[col_idx].obj;
+			auto dest = (char *)PyArray_DATA(arr) + dest_offset * PyArray_ITEMSIZE(arr);
+			auto &col = rc.cols[col_idx];
+			if (col.col->type == parquet::format::Type::BYTE_ARRAY) {
+				PythonGILGuard gil;
+				convert_rows(*col.col, col, rc.nrows, dest);
+			} else {
+				convert_rows(*col.col, col, rc.nrows, dest);
+			}
+		}
+	}
+
+	// the finished columns by name, needs the GIL. The arrays are handed over.
+	PyObject *to_dict() {
+		PythonWrapperObject res(PyDict_New());
+		for (size_t col_idx = 0; col_idx < columns.size(); col_idx++) {
+			auto &name = columns[col_idx]->name;
+			PythonWrapperObject pyname(PyUnicode_DecodeUTF8(name.c_str(), name.size(), nullptr));
+			PythonWrapperObject column(finish_column(*columns[col_idx], arrays[col_idx], masks[col_idx]));
+			if (PyDict_SetItem(res.obj, pyname.obj, column.obj) != 0) {
+				throw runtime_error("Could not build result");
+			}
+		}
+		return res.Release();
+	}
+
+	vector<ParquetColumn *> columns;
+	vector<PythonWrapperObject> arrays;
+	vector<PythonWrapperObject> masks;
+};
+
+// a row group and the rows of the result it goes to
+struct ScanTask {
+	ParquetFile *file;
+	uint64_t row_group_idx;
+	uint64_t dest_offset;
+	uint64_t nrows;
+};
+
+static PyObject *miniparquet_read(PyObject *self, PyObject *args, PyObject *kwargs) {
+	static const char *kwlist[] = {"source", "threads", nullptr};
+	PyObject *source;
+	int threads = 1;
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|i", (char **)kwlist, &source, &threads)) {
 		return NULL;
 	}
+	if (threads < 1) {
+		PyErr_SetString(PyExc_ValueError, "threads must be at least 1");
+		return NULL;
+	}
+
+	// a list or tuple of files is read as one table
+	vector<unique_ptr<ReadInput>> inputs;
+	if (PyList_Check(source) || PyTuple_Check(source)) {
+		PythonWrapperObject seq(PySequence_Fast(source, "Need a list of files"));
+		for (Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(seq.obj); i++) {
+			inputs.push_back(unique_ptr<ReadInput>(new ReadInput()));
+			if (!parse_input(PySequence_Fast_GET_ITEM(seq.obj, i), *inputs.back())) {
+				return NULL;
+			}
+		}
+		if (inputs.empty()) {
+			PyErr_SetString(PyExc_ValueError, "Need at least one file");
+			return NULL;
+		}
+	} else {
+		inputs.push_back(unique_ptr<ReadInput>(new ReadInput()));
+		if (!parse_input(source, *inputs.back())) {
+			return NULL;
+		}
+	}
 
 	try {
-		// parse the query and transform it into a set of statements
-		ParquetFile f(fname);
+		// the footers are read and parsed without the GIL, in parallel for several files
+		string error;
+		Py_BEGIN_ALLOW_THREADS;
+		error = parallel_for(inputs.size(), threads, [&](size_t i) { open_input(*inputs[i]); });
+		Py_END_ALLOW_THREADS;
+		if (!error.empty()) {
+			throw runtime_error(error);
+		}
 
-		auto ncols = f.columns.size();
-		auto nrows = f.nrow;
+		auto &first = *inputs[0]->file;
+		auto ncols = first.columns.size();
+		vector<ScanTask> tasks;
+		uint64_t nrows = 0;
+		for (auto &input : inputs) {
+			auto &f = *input->file;
+			if (f.columns.size() != ncols) {
+				throw runtime_error("Files have different numbers of columns");
+			}
+			for (size_t col_idx = 0; col_idx < ncols; col_idx++) {
+				if (!same_column(*f.columns[col_idx], *first.columns[col_idx])) {
+					throw runtime_error("Files have different types for column " + first.columns[col_idx]->name);
+				}
+			}
+			uint64_t file_rows = 0;
+			auto &row_groups = f.meta_data().row_groups;
+			for (uint64_t rg = 0; rg < row_groups.size(); rg++) {
+				tasks.push_back({&f, rg, nrows + file_rows, (uint64_t)row_groups[rg].num_rows});
+				file_rows += row_groups[rg].num_rows;
+			}
+			if (file_rows != f.nrow) {
+				throw runtime_error("Row groups do not add up to the number of rows. File corrupt?");
+			}
+			nrows += file_rows;
+		}
+		vector<ParquetColumn *> columns;
+		for (auto &col : first.columns) {
+			columns.push_back(col.get());
+		}
+		NumpyColumns result(columns, nrows);
+
+		// row groups are decoded without the GIL, each into its own rows of the arrays
+		Py_BEGIN_ALLOW_THREADS;
+		error = parallel_for(tasks.size(), threads, [&](size_t i) {
+			auto &task = tasks[i];
+			ResultChunk rc;
+			task.file->initialize_result(rc);
+			ScanState s;
+			s.row_group_idx = task.row_group_idx;
+			result.scan(*task.file, s, rc, task.dest_offset, task.nrows);
+		});
+		Py_END_ALLOW_THREADS;
+		if (!error.empty()) {
+			throw runtime_error(error);
+		}
+		return result.to_dict();
+	} catch (std::exception &ex) {
+		if (!PyErr_Occurred()) {
+			PyErr_SetString(PyExc_RuntimeError, ex.what());
+		}
+		return NULL;
+	}
+}
+
+// unsigned integers have statistics in unsigned order, but they are decoded as signed
+static bool unsigned_statistics(const parquet::format::SchemaElement &s_ele) {
+	if (s_ele.__isset.logicalType && s_ele.logicalType.__isset.INTEGER) {
+		return !s_ele.logicalType.INTEGER.isSigned;
+	}
+	if (!s_ele.__isset.converted_type) {
+		return false;
+	}
+	switch (s_ele.converted_type) {
+	case parquet::format::ConvertedType::UINT_8:
+	case parquet::format::ConvertedType::UINT_16:
+	case parquet::format::ConvertedType::UINT_32:
+	case parquet::format::ConvertedType::UINT_64:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// a statistics value as the Python object the column's values are compared with, nullptr if there is none
+static PyObject *stat_to_python(ParquetColumn &col, const string &bytes) {
+	if (unsigned_statistics(*col.schema_element)) {
+		return nullptr;
+	}
+	switch (col.type) {
+	case parquet::format::Type::INT32: {
+		int32_t val;
+		if (bytes.size() != sizeof(val)) {
+			return nullptr;
+		}
+		memcpy(&val, bytes.data(), sizeof(val));
+		return PyLong_FromLong(val);
+	}
+	case parquet::format::Type::INT64: {
+		int64_t val;
+		if (bytes.size() != sizeof(val)) {
+			return nullptr;
+		}
+		memcpy(&val, bytes.data(), sizeof(val));
+		return PyLong_FromLongLong(val);
+	}
+	case parquet::format::Type::FLOAT: {
+		float val;
+		if (bytes.size() != sizeof(val)) {
+			return nullptr;
+		}
+		memcpy(&val, bytes.data(), sizeof(val));
+		return PyFloat_FromDouble(val);
+	}
+	case parquet::format::Type::DOUBLE: {
+		double val;
+		if (bytes.size() != sizeof(val)) {
+			return nullptr;
+		}
+		memcpy(&val, bytes.data(), sizeof(val));
+		return PyFloat_FromDouble(val);
+	}
+	case parquet::format::Type::BYTE_ARRAY: {
+		// byte order is code point order for UTF-8, so string statistics compare like Python strings
+		auto &s_ele = *col.schema_element;
+		if (!(s_ele.__isset.converted_type && s_ele.converted_type == parquet::format::ConvertedType::UTF8) &&
+		    !(s_ele.__isset.logicalType && s_ele.logicalType.__isset.STRING)) {
+			return nullptr;
+		}
+		auto res = PyUnicode_DecodeUTF8(bytes.data(), bytes.size(), nullptr);
+		if (!res) {
+			PyErr_Clear();
+		}
+		return res;
+	}
+	default:
+		return nullptr;
+	}
+}
 
-		PythonWrapperObject rdict(PyDict_New());
-		auto pynames = unique_ptr<PythonWrapperObject[]>(new PythonWrapperObject[ncols]);
-		auto pylists = unique_ptr<PythonWrapperObject[]>(new PythonWrapperObject[ncols]);
+// a filter term (column, op, value), rows match if all terms are true for them
+struct Predicate {
+	string column;
+	uint64_t col_idx;
+	int op; // Py_EQ, Py_LT etc.
+	PythonWrapperObject value;
+};
 
-		for (size_t col_idx = 0; col_idx < ncols; col_idx++) {
-			auto name = f.columns[col_idx]->name;
-			pynames[col_idx].obj = PyUnicode_DecodeUTF8(name.c_str(), name.size(), nullptr);
-			pylists[col_idx].obj = PyList_New(nrows);
-			PyDict_SetItem(rdict.obj, pynames[col_idx].obj, pylists[col_idx].obj);
+static bool parse_filter(PyObject *filter, ParquetFile &f, vector<Predicate> &res) {
+	const pair<const char *, int> ops[] = {{"==", Py_EQ}, {"=", Py_EQ}, {"!=", Py_NE}, {"<", Py_LT},
+	                                       {"<=", Py_LE}, {">", Py_GT}, {">=", Py_GE}};
+	PythonWrapperObject seq(PySequence_Fast(filter, "filter needs to be a list of (column, op, value) tuples"));
+	for (Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(seq.obj); i++) {
+		auto term = PySequence_Fast_GET_ITEM(seq.obj, i);
+		const char *column, *op;
+		PyObject *value;
+		if (!PyTuple_Check(term) || !PyArg_ParseTuple(term, "ssO", &column, &op, &value)) {
+			PyErr_Clear();
+			PyErr_SetString(PyExc_ValueError, "filter needs to be a list of (column, op, value) tuples");
+			return false;
 		}
+		Predicate pred;
+		pred.column = column;
+		pred.op = -1;
+		for (auto &candidate : ops) {
+			if (strcmp(op, candidate.first) == 0) {
+				pred.op = candidate.second;
+			}
+		}
+		if (pred.op < 0) {
+			PyErr_Format(PyExc_ValueError, "Unknown filter operator %s", op);
+			return false;
+		}
+		pred.col_idx = f.columns.size();
+		for (uint64_t col_idx = 0; col_idx < f.columns.size(); col_idx++) {
+			if (f.columns[col_idx]->name == pred.column) {
+				pred.col_idx = col_idx;
+			}
+		}
+		if (pred.col_idx == f.columns.size()) {
+			PyErr_Format(PyExc_KeyError, "No column %s", column);
+			return false;
+		}
+		Py_INCREF(value);
+		pred.value = PythonWrapperObject(value);
+		res.push_back(move(pred));
+	}
+	return true;
+}
 
-		ResultChunk rc;
-		ScanState s;
+// compares Python objects, -1 if they cannot be compared
+static int compare(PyObject *a, PyObject *b, int op) {
+	auto res = PyObject_RichCompareBool(a, b, op);
+	if (res < 0) {
+		PyErr_Clear();
+	}
+	return res;
+}
 
-		f.initialize_result(rc);
-		uint64_t dest_offset = 0;
+// false if the statistics of a row group rule out any match of pred
+static bool may_match(ParquetFile &f, uint64_t row_group_idx, Predicate &pred) {
+	string min_bytes, max_bytes;
+	if (!f.chunk_min_max(row_group_idx, pred.col_idx, min_bytes, max_bytes)) {
+		return true;
+	}
+	auto &col = *f.columns[pred.col_idx];
+	auto min_ptr = stat_to_python(col, min_bytes);
+	if (!min_ptr) {
+		return true;
+	}
+	PythonWrapperObject min(min_ptr);
+	auto max_ptr = stat_to_python(col, max_bytes);
+	if (!max_ptr) {
+		return true;
+	}
+	PythonWrapperObject max(max_ptr);
+	auto value = pred.value.obj;
+	switch (pred.op) {
+	case Py_EQ:
+		return compare(value, min.obj, Py_LT) != 1 && compare(value, max.obj, Py_GT) != 1;
+	case Py_NE:
+		return !(compare(min.obj, max.obj, Py_EQ) == 1 && compare(min.obj, value, Py_EQ) == 1);
+	case Py_LT:
+		return compare(min.obj, value, Py_GE) != 1;
+	case Py_LE:
+		return compare(min.obj, value, Py_GT) != 1;
+	case Py_GT:
+		return compare(max.obj, value, Py_LE) != 1;
+	case Py_GE:
+		return compare(max.obj, value, Py_LT) != 1;
+	default:
+		return true;
+	}
+}
 
-		while (f.scan(s, rc)) {
-			for (size_t col_idx = 0; col_idx < ncols; col_idx++) {
-				auto &col = rc.cols[col_idx];
-				for (uint64_t row_idx = 0; row_idx < rc.nrows; row_idx++) {
-					uint64_t target_idx = dest_offset + row_idx;
-					PyObject *current_item = nullptr;
-					if (!col.defined.ptr[row_idx]) {
-						// NULL
-						Py_INCREF(Py_None);
-						current_item = Py_None;
-					} else {
-						switch (f.columns[col_idx]->type) {
-						case parquet::format::Type::BOOLEAN: {
-							auto value = ((bool *)col.data.ptr)[row_idx];
-							current_item = PyBool_FromLong(value);
-							break;
-						}
-						case parquet::format::Type::INT32: {
-							auto value = ((int32_t *)col.data.ptr)[row_idx];
-							current_item = PyLong_FromLong(value);
-							break;
-						}
-						case parquet::format::Type::INT64: {
-							auto value = ((int64_t *)col.data.ptr)[row_idx];
-							current_item = PyLong_FromLong(value);
-							break;
-						}
-						case parquet::format::Type::DOUBLE: {
-							auto value = ((double *)col.data.ptr)[row_idx];
-							current_item = PyFloat_FromDouble(value);
-							break;
-						}
-						case parquet::format::Type::FLOAT: {
-							auto value = ((float *)col.data.ptr)[row_idx];
-							current_item = PyFloat_FromDouble(value);
-							break;
-						}
-						case parquet::format::Type::INT96: {
-							auto nanoseconds =
-							    impala_timestamp_to_nanoseconds(((Int96 *)col.data.ptr)[row_idx]) / 1000000000;
-							current_item = PyLong_FromLong(nanoseconds);
-							break;
-						}
-						case parquet::format::Type::FIXED_LEN_BYTE_ARRAY: { // oof, TODO clusterfuck
-							auto &s_ele = f.columns[col_idx]->schema_element;
-							if (!s_ele->__isset.converted_type) {
-								throw runtime_error("Missing FLBA type");
-							}
-							switch (s_ele->converted_type) {
-							case parquet::format::ConvertedType::DECIMAL: {
-
-								// this is a giant clusterfuck
-								auto type_len = s_ele->type_length;
-								auto bytes = ((char **)col.data.ptr)[row_idx];
-								int64_t val = 0;
-								for (auto i = 0; i < type_len; i++) {
-									val = val << ((type_len - i) * 8) | (uint8_t)bytes[i];
-								}
-
-								auto dbl = val / pow(10.0, s_ele->scale);
-								current_item = PyFloat_FromDouble(dbl);
-								break;
-							}
-							default:
-								throw runtime_error("unknown FLBA type");
-							}
-							break;
-						}
-						case parquet::format::Type::BYTE_ARRAY: {
-							auto value = ((char **)col.data.ptr)[row_idx];
-							current_item = PyUnicode_DecodeUTF8(value, strlen(value), nullptr);
-							break;
-						}
-						default: {
-							throw runtime_error("unknown column type");
-						}
-						}
-					}
-					PyList_SetItem(pylists[col_idx].obj, target_idx, current_item);
+// the rows of a decoded row group where pred is true, as a NumPy bool array. NULLs never match.
+static PyObject *evaluate(Predicate &pred, PyObject *column, npy_intp nrows) {
+	if (PyArray_Check(column) && PyArray_TYPE((PyArrayObject *)column) == NPY_OBJECT) {
+		// strings, None for NULLs
+		npy_intp dims[] = {nrows};
+		PythonWrapperObject res(PyArray_SimpleNew(1, dims, NPY_BOOL));
+		auto res_data = (npy_bool *)PyArray_DATA((PyArrayObject *)res.obj);
+		auto values = (PyObject **)PyArray_DATA((PyArrayObject *)column);
+		for (npy_intp row_idx = 0; row_idx < nrows; row_idx++) {
+			res_data[row_idx] = 0;
+			if (values[row_idx] != Py_None) {
+				auto cmp = PyObject_RichCompareBool(values[row_idx], pred.value.obj, pred.op);
+				if (cmp < 0) {
+					return nullptr;
 				}
+				res_data[row_idx] = cmp;
 			}
-			dest_offset += rc.nrows;
 		}
-		assert(dest_offset == nrows);
-		return rdict.Release();
+		return res.Release();
+	}
+	auto cmp = PyObject_RichCompare(column, pred.value.obj, pred.op);
+	if (!cmp) {
+		return nullptr;
+	}
+	PythonWrapperObject cmp_wrapper(cmp);
+	if (PyObject_IsInstance(cmp, masked_array_type) == 1) {
+		return PyObject_CallMethod(cmp, "filled", "O", Py_False);
+	}
+	Py_INCREF(cmp);
+	return cmp;
+}
+
+struct PythonParquetFile {
+	PyObject_HEAD ReadInput *input;
+};
+
+// state of an iter_batches() iterator
+struct BatchScan {
+	PythonWrapperObject file; // the PythonParquetFile, keeps the file open
+	ParquetFile *f;
+	// the requested columns, followed by the ones only needed for the filter
+	vector<uint64_t> column_ids;
+	size_t output_columns;
+	vector<Predicate> predicates;
+	uint64_t batch_size; // 0 for whole row groups
+	ScanState state;
+	ResultChunk rc;
+	// the filtered rows of the current row group
+	PythonWrapperObject rows;
+	uint64_t rows_count = 0, rows_offset = 0;
+	bool busy = false;
+};
+
+struct PythonBatchIterator {
+	PyObject_HEAD BatchScan *scan;
+};
+
+static PyTypeObject PythonBatchIteratorType = {PyVarObject_HEAD_INIT(NULL, 0)};
+
+static bool scan_row_group(BatchScan &scan) {
+	auto &f = *scan.f;
+	auto &row_groups = f.meta_data().row_groups;
+	while (scan.state.row_group_idx < row_groups.size()) {
+		bool match = true;
+		for (auto &pred : scan.predicates) {
+			match = match && may_match(f, scan.state.row_group_idx, pred);
+		}
+		if (match) {
+			break;
+		}
+		scan.state.row_group_idx++;
+	}
+	if (scan.state.row_group_idx >= row_groups.size()) {
+		return false;
+	}
+
+	uint64_t nrows = row_groups[scan.state.row_group_idx].num_rows;
+	vector<ParquetColumn *> columns;
+	for (auto col_idx : scan.column_ids) {
+		columns.push_back(f.columns[col_idx].get());
+	}
+	NumpyColumns result(columns, nrows);
+	string error;
+	Py_BEGIN_ALLOW_THREADS;
+	try {
+		result.scan(f, scan.state, scan.rc, 0, nrows);
+	} catch (std::exception &ex) {
+		error = ex.what();
+	}
+	Py_END_ALLOW_THREADS;
+	if (!error.empty()) {
+		throw runtime_error(error);
+	}
+	PythonWrapperObject all(result.to_dict());
+
+	// rows that match all predicates
+	PythonWrapperObject selection;
+	for (auto &pred : scan.predicates) {
+		PythonWrapperObject matches(evaluate(pred, PyDict_GetItemString(all.obj, pred.column.c_str()), nrows));
+		if (!PyArray_Check(matches.obj) || PyArray_NDIM((PyArrayObject *)matches.obj) != 1 ||
+		    PyArray_SIZE((PyArrayObject *)matches.obj) != (npy_intp)nrows) {
+			PyErr_Format(PyExc_TypeError, "Cannot compare column %s with %R", pred.column.c_str(), pred.value.obj);
+			throw runtime_error("Invalid filter");
+		}
+		if (selection.obj) {
+			selection = PythonWrapperObject(PyNumber_And(selection.obj, matches.obj));
+		} else {
+			selection = move(matches);
+		}
+	}
+
+	scan.rows = PythonWrapperObject(PyDict_New());
+	scan.rows_count = selection.obj ? PyArray_CountNonzero((PyArrayObject *)selection.obj) : nrows;
+	scan.rows_offset = 0;
+	for (size_t i = 0; i < scan.output_columns; i++) {
+		auto &name = f.columns[scan.column_ids[i]]->name;
+		auto column = PyDict_GetItemString(all.obj, name.c_str());
+		if (selection.obj) {
+			PythonWrapperObject selected(PyObject_GetItem(column, selection.obj));
+			PyDict_SetItemString(scan.rows.obj, name.c_str(), selected.obj);
+		} else {
+			PyDict_SetItemString(scan.rows.obj, name.c_str(), column);
+		}
+	}
+	return true;
+}
+
+static PyObject *batch_iterator_next(PythonBatchIterator *self) {
+	auto &scan = *self->scan;
+	if (scan.busy) {
+		PyErr_SetString(PyExc_RuntimeError, "Iterator is already in use by another thread");
+		return NULL;
+	}
+	scan.busy = true;
+	try {
+		while (scan.rows_offset >= scan.rows_count) {
+			if (!scan_row_group(scan)) {
+				scan.busy = false;
+				return NULL; // StopIteration
+			}
+		}
+		PyObject *res;
+		if (scan.batch_size == 0 || (scan.rows_offset == 0 && scan.rows_count <= scan.batch_size)) {
+			Py_INCREF(scan.rows.obj);
+			res = scan.rows.obj;
+			scan.rows_offset = scan.rows_count;
+		} else {
+			// slices are views on the row group's arrays
+			auto end = min(scan.rows_offset + scan.batch_size, scan.rows_count);
+			PythonWrapperObject batch(PyDict_New());
+			PyObject *name, *column;
+			Py_ssize_t pos = 0;
+			while (PyDict_Next(scan.rows.obj, &pos, &name, &column)) {
+				PythonWrapperObject slice(PySequence_GetSlice(column, scan.rows_offset, end));
+				PyDict_SetItem(batch.obj, name, slice.obj);
+			}
+			scan.rows_offset = end;
+			res = batch.Release();
+		}
+		scan.busy = false;
+		return res;
+	} catch (std::exception &ex) {
+		scan.busy = false;
+		if (!PyErr_Occurred()) {
+			PyErr_SetString(PyExc_RuntimeError, ex.what());
+		}
+		return NULL;
+	}
+}
+
+static void batch_iterator_dealloc(PythonBatchIterator *self) {
+	delete self->scan;
+	Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+// exports the memory of one decoded column through the buffer protocol. chunk is a capsule owning
+// the ResultChunk the memory belongs to, so it lives as long as any view on it.
+struct PythonColumnBuffer {
+	PyObject_HEAD PyObject *chunk;
+	char *ptr;
+	const char *format;
+	Py_ssize_t nrows;
+	Py_ssize_t itemsize;
+};
+
+static PyTypeObject PythonColumnBufferType = {PyVarObject_HEAD_INIT(NULL, 0)};
+
+static int column_buffer_getbuffer(PythonColumnBuffer *self, Py_buffer *view, int flags) {
+	if ((flags & PyBUF_WRITABLE) == PyBUF_WRITABLE) {
+		PyErr_SetString(PyExc_BufferError, "Column buffers are read-only");
+		view->obj = NULL;
+		return -1;
+	}
+	Py_INCREF(self);
+	view->obj = (PyObject *)self;
+	view->buf = self->ptr;
+	view->len = self->nrows * self->itemsize;
+	view->readonly = 1;
+	view->itemsize = self->itemsize;
+	view->format = (flags & PyBUF_FORMAT) ? (char *)self->format : NULL;
+	view->ndim = 1;
+	view->shape = (flags & PyBUF_ND) == PyBUF_ND ? &self->nrows : NULL;
+	view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? &self->itemsize : NULL;
+	view->suboffsets = NULL;
+	view->internal = NULL;
+	return 0;
+}
+
+static PyBufferProcs column_buffer_as_buffer = {(getbufferproc)column_buffer_getbuffer, nullptr};
+
+static void column_buffer_dealloc(PythonColumnBuffer *self) {
+	Py_XDECREF(self->chunk);
+	Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static void release_chunk_capsule(PyObject *capsule) {
+	delete (ResultChunk *)PyCapsule_GetPointer(capsule, "miniparquet.ResultChunk");
+}
+
+// a read-only memoryview of nrows items of the given struct format at ptr, which belongs to chunk
+static PyObject *column_memoryview(PyObject *chunk, char *ptr, Py_ssize_t nrows, Py_ssize_t itemsize,
+                                   const char *format) {
+	auto buffer = PyObject_New(PythonColumnBuffer, &PythonColumnBufferType);
+	if (!buffer) {
+		throw runtime_error("Could not create column buffer");
+	}
+	Py_INCREF(chunk);
+	buffer->chunk = chunk;
+	// buffers of empty columns may not be allocated
+	static char empty;
+	buffer->ptr = ptr ? ptr : &empty;
+	buffer->format = format;
+	buffer->nrows = nrows;
+	buffer->itemsize = itemsize;
+	PythonWrapperObject buffer_wrapper((PyObject *)buffer);
+	return PythonWrapperObject(PyMemoryView_FromObject(buffer_wrapper.obj)).Release();
+}
+
+static int parquet_file_init(PythonParquetFile *self, PyObject *args, PyObject *kwargs) {
+	static const char *kwlist[] = {"source", nullptr};
+	PyObject *source;
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O", (char **)kwlist, &source)) {
+		return -1;
+	}
+	if (self->input) {
+		PyErr_SetString(PyExc_RuntimeError, "ParquetFile is already open");
+		return -1;
+	}
+	self->input = new ReadInput();
+	if (!parse_input(source, *self->input)) {
+		return -1;
+	}
+	string error;
+	Py_BEGIN_ALLOW_THREADS;
+	try {
+		open_input(*self->input);
+	} catch (std::exception &ex) {
+		error = ex.what();
+	}
+	Py_END_ALLOW_THREADS;
+	if (!error.empty()) {
+		PyErr_SetString(PyExc_RuntimeError, error.c_str());
+		return -1;
+	}
+	return 0;
+}
+
+static void parquet_file_dealloc(PythonParquetFile *self) {
+	delete self->input;
+	Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static ParquetFile *get_file(PythonParquetFile *self) {
+	if (!self->input || !self->input->file) {
+		PyErr_SetString(PyExc_RuntimeError, "ParquetFile is not open");
+		return nullptr;
+	}
+	return self->input->file.get();
+}
+
+// index of the column with the given name, the number of columns if there is none
+static uint64_t find_column(ParquetFile &f, const string &name) {
+	for (uint64_t col_idx = 0; col_idx < f.columns.size(); col_idx++) {
+		if (f.columns[col_idx]->name == name) {
+			return col_idx;
+		}
+	}
+	return f.columns.size();
+}
+
+static PyObject *parquet_file_num_rows(PythonParquetFile *self, void *closure) {
+	auto f = get_file(self);
+	return f ? PyLong_FromUnsignedLongLong(f->nrow) : NULL;
+}
+
+// the NumPy types of the columns by name, None for columns we cannot read
+static PyObject *parquet_file_schema(PythonParquetFile *self, void *closure) {
+	auto f = get_file(self);
+	if (!f) {
+		return NULL;
+	}
+	try {
+		PythonWrapperObject res(PyDict_New());
+		for (auto &col : f->columns) {
+			PyObject *descr;
+			try {
+				descr = (PyObject *)numpy_descr(*col);
+			} catch (std::exception &ex) {
+				Py_INCREF(Py_None);
+				descr = Py_None;
+			}
+			PythonWrapperObject descr_wrapper(descr);
+			PyDict_SetItemString(res.obj, col->name.c_str(), descr);
+		}
+		return res.Release();
+	} catch (std::exception &ex) {
+		return NULL;
+	}
+}
+
+static PyObject *parquet_file_metadata(PythonParquetFile *self, void *closure) {
+	auto f = get_file(self);
+	if (!f) {
+		return NULL;
+	}
+	try {
+		auto &meta_data = f->meta_data();
+		PythonWrapperObject key_value(PyDict_New());
+		for (auto &kv : meta_data.key_value_metadata) {
+			PythonWrapperObject value(kv.__isset.value ? PyUnicode_DecodeUTF8(kv.value.data(), kv.value.size(), "replace")
+			                                           : (Py_INCREF(Py_None), Py_None));
+			PyDict_SetItemString(key_value.obj, kv.key.c_str(), value.obj);
+		}
+		PythonWrapperObject row_groups(PyList_New(0));
+		for (auto &row_group : meta_data.row_groups) {
+			PythonWrapperObject rg(Py_BuildValue("{s:L,s:L}", "num_rows", (long long)row_group.num_rows,
+			                                     "total_byte_size", (long long)row_group.total_byte_size));
+			PyList_Append(row_groups.obj, rg.obj);
+		}
+		PythonWrapperObject created_by(meta_data.__isset.created_by
+		                                   ? PyUnicode_DecodeUTF8(meta_data.created_by.data(),
+		                                                          meta_data.created_by.size(), "replace")
+		                                   : (Py_INCREF(Py_None), Py_None));
+		return Py_BuildValue("{s:L,s:i,s:O,s:O,s:O}", "num_rows", (long long)meta_data.num_rows, "version",
+		                     meta_data.version, "created_by", created_by.obj, "key_value_metadata", key_value.obj,
+		                     "row_groups", row_groups.obj);
+	} catch (std::exception &ex) {
+		return NULL;
+	}
+}
+
+static PyObject *parquet_file_iter_batches(PythonParquetFile *self, PyObject *args, PyObject *kwargs) {
+	static const char *kwlist[] = {"columns", "filter", "batch_size", nullptr};
+	PyObject *columns = Py_None, *filter = Py_None, *batch_size_obj = Py_None;
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|OOO", (char **)kwlist, &columns, &filter, &batch_size_obj)) {
+		return NULL;
+	}
+	auto f = get_file(self);
+	if (!f) {
+		return NULL;
+	}
+	long long batch_size = 0;
+	if (batch_size_obj != Py_None) {
+		batch_size = PyLong_AsLongLong(batch_size_obj);
+		if (batch_size == -1 && PyErr_Occurred()) {
+			return NULL;
+		}
+		if (batch_size < 1) {
+			PyErr_SetString(PyExc_ValueError, "batch_size must be at least 1");
+			return NULL;
+		}
+	}
+	try {
+		unique_ptr<BatchScan> scan(new BatchScan());
+		Py_INCREF(self);
+		scan->file = PythonWrapperObject((PyObject *)self);
+		scan->f = f;
+		scan->batch_size = batch_size;
+
+		auto add_column = [&](uint64_t col_idx) {
+			if (find(scan->column_ids.begin(), scan->column_ids.end(), col_idx) == scan->column_ids.end()) {
+				scan->column_ids.push_back(col_idx);
+			}
+		};
+		if (columns == Py_None) {
+			for (uint64_t col_idx = 0; col_idx < f->columns.size(); col_idx++) {
+				add_column(col_idx);
+			}
+		} else {
+			PythonWrapperObject seq(PySequence_Fast(columns, "columns needs to be a list of column names"));
+			for (Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(seq.obj); i++) {
+				auto name = PyUnicode_AsUTF8(PySequence_Fast_GET_ITEM(seq.obj, i));
+				if (!name) {
+					return NULL;
+				}
+				auto col_idx = find_column(*f, name);
+				if (col_idx == f->columns.size()) {
+					PyErr_Format(PyExc_KeyError, "No column %s", name);
+					return NULL;
+				}
+				add_column(col_idx);
+			}
+		}
+		scan->output_columns = scan->column_ids.size();
+		if (filter != Py_None) {
+			if (!parse_filter(filter, *f, scan->predicates)) {
+				return NULL;
+			}
+			for (auto &pred : scan->predicates) {
+				add_column(pred.col_idx);
+			}
+		}
+		f->initialize_result(scan->rc, scan->column_ids);
+
+		auto res = PyObject_New(PythonBatchIterator, &PythonBatchIteratorType);
+		if (!res) {
+			return NULL;
+		}
+		res->scan = scan.release();
+		return (PyObject *)res;
+	} catch (std::exception &ex) {
+		if (!PyErr_Occurred()) {
+			PyErr_SetString(PyExc_RuntimeError, ex.what());
+		}
+		return NULL;
+	}
+}
+
+// decodes a row group and returns memoryviews on the values and validity of its fixed-width columns
+static PyObject *parquet_file_row_group_buffers(PythonParquetFile *self, PyObject *args, PyObject *kwargs) {
+	static const char *kwlist[] = {"row_group", "columns", nullptr};
+	Py_ssize_t row_group;
+	PyObject *columns = Py_None;
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "n|O", (char **)kwlist, &row_group, &columns)) {
+		return NULL;
+	}
+	auto f = get_file(self);
+	if (!f) {
+		return NULL;
+	}
+	if (row_group < 0 || (size_t)row_group >= f->meta_data().row_groups.size()) {
+		PyErr_SetString(PyExc_IndexError, "Row group index out of range");
+		return NULL;
+	}
+	try {
+		vector<uint64_t> column_ids;
+		if (columns == Py_None) {
+			for (uint64_t col_idx = 0; col_idx < f->columns.size(); col_idx++) {
+				if (decodes_in_place(*f->columns[col_idx])) {
+					column_ids.push_back(col_idx);
+				}
+			}
+		} else {
+			PythonWrapperObject seq(PySequence_Fast(columns, "columns needs to be a list of column names"));
+			for (Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(seq.obj); i++) {
+				auto name = PyUnicode_AsUTF8(PySequence_Fast_GET_ITEM(seq.obj, i));
+				if (!name) {
+					return NULL;
+				}
+				auto col_idx = find_column(*f, name);
+				if (col_idx == f->columns.size()) {
+					PyErr_Format(PyExc_KeyError, "No column %s", name);
+					return NULL;
+				}
+				if (!decodes_in_place(*f->columns[col_idx])) {
+					PyErr_Format(PyExc_ValueError, "Column %s does not have a fixed-width type", name);
+					return NULL;
+				}
+				column_ids.push_back(col_idx);
+			}
+		}
+
+		unique_ptr<ResultChunk> rc(new ResultChunk());
+		f->initialize_result(*rc, column_ids);
+		string error;
+		Py_BEGIN_ALLOW_THREADS;
+		try {
+			ScanState s;
+			s.row_group_idx = row_group;
+			f->scan(s, *rc);
+		} catch (std::exception &ex) {
+			error = ex.what();
+		}
+		Py_END_ALLOW_THREADS;
+		if (!error.empty()) {
+			PyErr_SetString(PyExc_RuntimeError, error.c_str());
+			return NULL;
+		}
+
+		PythonWrapperObject chunk(PyCapsule_New(rc.get(), "miniparquet.ResultChunk", release_chunk_capsule));
+		auto chunk_ptr = rc.release();
+		PythonWrapperObject res(PyDict_New());
+		for (auto &col : chunk_ptr->cols) {
+			const char *format;
+			Py_ssize_t itemsize;
+			switch (col.col->type) {
+			case parquet::format::Type::BOOLEAN:
+				format = "?";
+				itemsize = sizeof(bool);
+				break;
+			case parquet::format::Type::INT32:
+				format = "i";
+				itemsize = sizeof(int32_t);
+				break;
+			case parquet::format::Type::INT64:
+				format = "q";
+				itemsize = sizeof(int64_t);
+				break;
+			case parquet::format::Type::FLOAT:
+				format = "f";
+				itemsize = sizeof(float);
+				break;
+			default:
+				format = "d";
+				itemsize = sizeof(double);
+			}
+			PythonWrapperObject values(column_memoryview(chunk.obj, col.data.ptr, chunk_ptr->nrows, itemsize, format));
+			PythonWrapperObject validity(column_memoryview(chunk.obj, col.defined.ptr, chunk_ptr->nrows, 1, "?"));
+			PythonWrapperObject pair(PyTuple_Pack(2, values.obj, validity.obj));
+			PyDict_SetItemString(res.obj, col.col->name.c_str(), pair.obj);
+		}
+		return res.Release();
+	} catch (std::exception &ex) {
+		if (!PyErr_Occurred()) {
+			PyErr_SetString(PyExc_RuntimeError, ex.what());
+		}
+		return NULL;
+	}
+}
+
+static void release_stream_capsule(PyObject *capsule) {
+	auto stream = (ArrowArrayStream *)PyCapsule_GetPointer(capsule, "arrow_array_stream");
+	// consumers that took over the stream have cleared release
+	if (stream->release) {
+		stream->release(stream);
+	}
+	delete stream;
+}
+
+// Arrow PyCapsule interface, lets pyarrow, polars, DuckDB etc. read the file as a stream of record batches
+static PyObject *parquet_file_arrow_c_stream(PythonParquetFile *self, PyObject *args, PyObject *kwargs) {
+	static const char *kwlist[] = {"requested_schema", nullptr};
+	PyObject *requested_schema = Py_None;
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O", (char **)kwlist, &requested_schema)) {
+		return NULL;
+	}
+	auto f = get_file(self);
+	if (!f) {
+		return NULL;
+	}
+	// the stream may outlive this object and be released on any thread, it keeps a reference that is
+	// dropped with the GIL held
+	Py_INCREF(self);
+	shared_ptr<ParquetFile> file(f, [self](ParquetFile *) {
+		PythonGILGuard gil;
+		Py_DECREF(self);
+	});
+	unique_ptr<ArrowArrayStream> stream(new ArrowArrayStream());
+	try {
+		vector<uint64_t> column_ids;
+		for (uint64_t col_idx = 0; col_idx < f->columns.size(); col_idx++) {
+			column_ids.push_back(col_idx);
+		}
+		export_arrow_stream(file, column_ids, stream.get());
 	} catch (std::exception &ex) {
 		PyErr_SetString(PyExc_RuntimeError, ex.what());
 		return NULL;
 	}
+	auto capsule = PyCapsule_New(stream.get(), "arrow_array_stream", release_stream_capsule);
+	if (!capsule) {
+		stream->release(stream.get());
+		return NULL;
+	}
+	stream.release();
+	return capsule;
 }
 
+static PyGetSetDef parquet_file_getset[] = {
+    {(char *)"num_rows", (getter)parquet_file_num_rows, nullptr, (char *)"Number of rows in the file.", nullptr},
+    {(char *)"schema", (getter)parquet_file_schema, nullptr,
+     (char *)"NumPy types of the columns by name, None for columns that cannot be read.", nullptr},
+    {(char *)"metadata", (getter)parquet_file_metadata, nullptr,
+     (char *)"File metadata: number of rows, format version, writer, key/value pairs and row groups.", nullptr},
+    {nullptr} /* Sentinel */
+};
+
+static PyMethodDef parquet_file_methods[] = {
+    {"iter_batches", (PyCFunction)parquet_file_iter_batches, METH_VARARGS | METH_KEYWORDS,
+     "iter_batches(columns=None, filter=None, batch_size=None)\n\nIterate over the rows as dicts of arrays like "
+     "read(), one row group is decoded at a time. columns selects columns by name. filter is a list of "
+     "(column, op, value) tuples that all have to be true for a row, op is one of == != < <= > >=. Row groups "
+     "whose statistics rule out a match are skipped. batch_size limits the number of rows per batch."},
+    {"row_group_buffers", (PyCFunction)parquet_file_row_group_buffers, METH_VARARGS | METH_KEYWORDS,
+     "row_group_buffers(row_group, columns=None)\n\nDecode a row group and return a dict of (values, validity) "
+     "memoryviews per column, without copying. Only fixed-width columns (bool, int32, int64, float, double) are "
+     "supported, columns=None selects all of them. validity is True for rows that are not NULL, values of NULL "
+     "rows are undefined."},
+    {"__arrow_c_stream__", (PyCFunction)parquet_file_arrow_c_stream, METH_VARARGS | METH_KEYWORDS,
+     "__arrow_c_stream__(requested_schema=None)\n\nExport the file as an Arrow C stream of one record batch per row "
+     "group in a PyCapsule. requested_schema is ignored."},
+    {NULL, NULL, 0, NULL} /* Sentinel */
+};
+
+static PyTypeObject PythonParquetFileType = {PyVarObject_HEAD_INIT(NULL, 0)};
+
 static PyMethodDef parquet_methods[] = {
-    {"read", miniparquet_read, METH_VARARGS, "Read a parquet file from disk."}, {NULL, NULL, 0, NULL} /* Sentinel */
+    {"read", (PyCFunction)miniparquet_read, METH_VARARGS | METH_KEYWORDS,
+     "read(source, threads=1)\n\nRead a parquet file from disk or from a bytes-like object. A list of those is read as "
+     "one table. threads decodes row groups and opens files in parallel."}, {NULL, NULL, 0, NULL} /* Sentinel */
 };
 
 static struct PyModuleDef miniparquetmodule = {PyModuleDef_HEAD_INIT, "miniparquet", /* name of module */
@@ -180,5 +1293,57 @@ static struct PyModuleDef miniparquetmodule = {PyModuleDef_HEAD_INIT, "miniparqu
                                                parquet_methods};
 
 PyMODINIT_FUNC PyInit_miniparquet(void) {
-	return PyModule_Create(&miniparquetmodule);
+	import_array();
+
+	PythonParquetFileType.tp_name = "miniparquet.ParquetFile";
+	PythonParquetFileType.tp_basicsize = sizeof(PythonParquetFile);
+	PythonParquetFileType.tp_flags = Py_TPFLAGS_DEFAULT;
+	PythonParquetFileType.tp_doc = "ParquetFile(source)\n\nA Parquet file opened from a file name or a bytes-like object.";
+	PythonParquetFileType.tp_new = PyType_GenericNew;
+	PythonParquetFileType.tp_init = (initproc)parquet_file_init;
+	PythonParquetFileType.tp_dealloc = (destructor)parquet_file_dealloc;
+	PythonParquetFileType.tp_methods = parquet_file_methods;
+	PythonParquetFileType.tp_getset = parquet_file_getset;
+	if (PyType_Ready(&PythonParquetFileType) < 0) {
+		return NULL;
+	}
+	PythonBatchIteratorType.tp_name = "miniparquet.BatchIterator";
+	PythonBatchIteratorType.tp_basicsize = sizeof(PythonBatchIterator);
+	PythonBatchIteratorType.tp_flags = Py_TPFLAGS_DEFAULT;
+	PythonBatchIteratorType.tp_dealloc = (destructor)batch_iterator_dealloc;
+	PythonBatchIteratorType.tp_iter = PyObject_SelfIter;
+	PythonBatchIteratorType.tp_iternext = (iternextfunc)batch_iterator_next;
+	if (PyType_Ready(&PythonBatchIteratorType) < 0) {
+		return NULL;
+	}
+	PythonColumnBufferType.tp_name = "miniparquet.ColumnBuffer";
+	PythonColumnBufferType.tp_basicsize = sizeof(PythonColumnBuffer);
+	PythonColumnBufferType.tp_flags = Py_TPFLAGS_DEFAULT;
+	PythonColumnBufferType.tp_dealloc = (destructor)column_buffer_dealloc;
+	PythonColumnBufferType.tp_as_buffer = &column_buffer_as_buffer;
+	if (PyType_Ready(&PythonColumnBufferType) < 0) {
+		return NULL;
+	}
+
+	PythonWrapperObject ma_module;
+	try {
+		ma_module = PythonWrapperObject(PyImport_ImportModule("numpy.ma"));
+	} catch (std::exception &ex) {
+		return NULL;
+	}
+	masked_array_type = PyObject_GetAttrString(ma_module.obj, "MaskedArray");
+	if (!masked_array_type) {
+		return NULL;
+	}
+	auto module = PyModule_Create(&miniparquetmodule);
+	if (!module) {
+		return NULL;
+	}
+	Py_INCREF(&PythonParquetFileType);
+	if (PyModule_AddObject(module, "ParquetFile", (PyObject *)&PythonParquetFileType) < 0) {
+		Py_DECREF(&PythonParquetFileType);
+		Py_DECREF(module);
+		return NULL;
+	}
+	return module;
 }
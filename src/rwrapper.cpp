@@ -5,10 +5,21 @@
 
 #include <iostream>
 #include <cmath>
+#include <algorithm>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
 
 #include "miniparquet.h"
 #undef ERROR
+#include <Rversion.h>
 #include <Rdefines.h>
+extern "C" {
+#include <R_ext/Altrep.h>
+}
 #undef nrows
 
 using namespace miniparquet;
@@ -28,25 +39,889 @@ static int64_t impala_timestamp_to_nanoseconds(const Int96& impala_timestamp) {
 	return days_since_epoch * kNanosecondsInADay + nanoseconds;
 }
 
-extern "C" {
+// FIXED_LEN_BYTE_ARRAY decimals are big-endian two's complement integers of any length
+static double decimal_to_double(const char *bytes, int32_t type_len,
+		int32_t scale) {
+	double val = type_len > 0 ? (int8_t) bytes[0] : 0;
+	for (auto i = 1; i < type_len; i++) {
+		val = val * 256 + (uint8_t) bytes[i];
+	}
+	return val / pow(10.0, scale);
+}
+
+// the type of the R vector for a column
+static SEXPTYPE r_type(ParquetColumn &col) {
+	switch (col.type) {
+	case parquet::format::Type::BOOLEAN:
+		return LGLSXP;
+	case parquet::format::Type::INT32:
+		return INTSXP;
+	case parquet::format::Type::INT64:
+	case parquet::format::Type::DOUBLE:
+	case parquet::format::Type::FLOAT:
+	case parquet::format::Type::INT96:
+		return REALSXP;
+	case parquet::format::Type::FIXED_LEN_BYTE_ARRAY: { // oof
+		auto& s_ele = col.schema_element;
+		if (!s_ele->__isset.converted_type) {
+			throw runtime_error("Missing FLBA type");
+		}
+		if (s_ele->converted_type != parquet::format::ConvertedType::DECIMAL) {
+			auto it = parquet::format::_ConvertedType_VALUES_TO_NAMES.find(
+					s_ele->converted_type);
+			throw runtime_error(
+					string("miniparquet_read: Unknown FLBA type ") + it->second);
+		}
+		return REALSXP;
+	}
+	case parquet::format::Type::BYTE_ARRAY:
+		return STRSXP;
+	default:
+		auto it = parquet::format::_Type_VALUES_TO_NAMES.find(col.type);
+		throw runtime_error(
+				string("miniparquet_read: Unknown column type ") + it->second); // unlikely
+	}
+}
+
+// timestamps are POSIXct
+static void set_column_class(ParquetColumn &col, SEXP varvalue) {
+	if (col.type != parquet::format::Type::INT96) {
+		return;
+	}
+	SEXP cl = PROTECT(NEW_STRING(2));
+	SET_STRING_ELT(cl, 0, PROTECT(mkChar("POSIXct")));
+	SET_STRING_ELT(cl, 1, PROTECT(mkChar("POSIXt")));
+	SET_CLASS(varvalue, cl);
+	setAttrib(varvalue, install("tzone"), PROTECT(mkString("UTC")));
+	UNPROTECT(4);
+}
+
+static void *r_values(SEXP vec) {
+	switch (TYPEOF(vec)) {
+	case LGLSXP:
+		return LOGICAL(vec);
+	case INTSXP:
+		return INTEGER(vec);
+	default:
+		return REAL(vec);
+	}
+}
+
+// INTEGER and REAL vectors have the layout of INT32 and DOUBLE columns, those are decoded straight
+// into them and the scan writes NA into NULL rows
+static void initialize_r_result(ParquetFile &f, ResultChunk &rc,
+		vector<uint64_t> column_ids) {
+	f.initialize_result(rc, column_ids);
+	int na_integer = NA_INTEGER;
+	double na_real = NA_REAL;
+	for (auto &col : rc.cols) {
+		switch (col.col->type) {
+		case parquet::format::Type::INT32:
+			col.null_value = string((char*) &na_integer, sizeof(na_integer));
+			break;
+		case parquet::format::Type::DOUBLE:
+			col.null_value = string((char*) &na_real, sizeof(na_real));
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+// the levels of a BYTE_ARRAY column read as factor, in the order they first appear
+struct FactorLevels {
+	unordered_map<string, int> codes;
+	vector<string> levels;
+
+	// the 1-based factor code of str, adding it as a level if it is new
+	int code(const char *str) {
+		auto res = codes.emplace(str, (int) levels.size() + 1);
+		if (res.second) {
+			levels.push_back(str);
+		}
+		return res.first->second;
+	}
+};
+
+// sets levels and class of a factor column once all of it is read
+static void set_factor_levels(FactorLevels &factor, SEXP varvalue) {
+	SEXP levels = PROTECT(NEW_STRING(factor.levels.size()));
+	for (size_t level_idx = 0; level_idx < factor.levels.size(); level_idx++) {
+		SET_STRING_ELT(levels, level_idx,
+				mkCharCE(factor.levels[level_idx].c_str(), CE_UTF8));
+	}
+	setAttrib(varvalue, R_LevelsSymbol, levels);
+	SET_CLASS(varvalue, PROTECT(mkString("factor")));
+	UNPROTECT(2);
+}
+
+// an R vector a column is read into
+struct RColumn {
+	SEXP vec;
+	// the data of vec, taken on the main thread as the R API must not be used by others. nullptr for strings.
+	void *values;
+	// for BYTE_ARRAY columns read as factor, whose vec is INTEGER
+	FactorLevels *factor;
+};
+
+static RColumn r_column(SEXP vec, FactorLevels *factor = nullptr) {
+	return RColumn { vec, TYPEOF(vec) == STRSXP ? nullptr : r_values(vec),
+			factor };
+}
+
+// a row group and the rows of the result it goes to
+struct ScanTask {
+	ParquetFile *file;
+	uint64_t row_group_idx;
+	uint64_t dest_offset;
+	// rows of the row group that are read, fewer than it has if n_max ends in it
+	uint64_t nrows;
+};
+
+// the row groups of files in order, up to n_max rows in total if that is not negative
+static vector<ScanTask> plan_scan(const vector<shared_ptr<ParquetFile>> &files,
+		double n_max, uint64_t &nrows) {
+	vector<ScanTask> tasks;
+	nrows = 0;
+	for (auto &f : files) {
+		uint64_t file_rows = 0;
+		auto &row_groups = f->meta_data().row_groups;
+		for (uint64_t rg = 0; rg < row_groups.size(); rg++) {
+			uint64_t rg_rows = row_groups[rg].num_rows;
+			if (n_max >= 0 && nrows + rg_rows > n_max) {
+				rg_rows = n_max - nrows;
+			}
+			if (rg_rows > 0) {
+				tasks.push_back( { f.get(), rg, nrows, rg_rows });
+			}
+			nrows += rg_rows;
+			file_rows += row_groups[rg].num_rows;
+		}
+		if (file_rows != f->nrow) {
+			throw runtime_error(
+					"Row groups do not add up to the number of rows. File corrupt?");
+		}
+	}
+	return tasks;
+}
+
+// decodes a row group into all but the string and factor columns. Does not use the R API, so it runs on any
+// thread. rc has to be initialized for the same columns and is needed for convert_strings() afterwards.
+static void decode_row_group(const ScanTask &task, ResultChunk &rc,
+		const vector<RColumn> &columns) {
+	auto &f = *task.file;
+	uint64_t rg_rows = f.meta_data().row_groups[task.row_group_idx].num_rows;
+	auto nrows = task.nrows;
+	// only whole row groups fit
+	bool in_place = nrows == rg_rows;
+	for (size_t col_idx = 0; col_idx < rc.cols.size(); col_idx++) {
+		auto values = (char*) columns[col_idx].values;
+		switch (rc.cols[col_idx].col->type) {
+		case parquet::format::Type::INT32:
+			if (in_place) {
+				rc.cols[col_idx].data.wrap(
+						values + task.dest_offset * sizeof(int),
+						rg_rows * sizeof(int));
+			} else {
+				// not into the rows of the previous row group
+				rc.cols[col_idx].data = ByteBuffer();
+			}
+			break;
+		case parquet::format::Type::DOUBLE:
+			if (in_place) {
+				rc.cols[col_idx].data.wrap(
+						values + task.dest_offset * sizeof(double),
+						rg_rows * sizeof(double));
+			} else {
+				// not into the rows of the previous row group
+				rc.cols[col_idx].data = ByteBuffer();
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
+	ScanState s;
+	s.row_group_idx = task.row_group_idx;
+	f.scan(s, rc);
+
+	// the other types need converting, one tight loop per column
+	for (size_t col_idx = 0; col_idx < rc.cols.size(); col_idx++) {
+		auto& col = rc.cols[col_idx];
+		auto defined = col.defined.ptr;
+		auto values = columns[col_idx].values;
+
+		switch (col.col->type) {
+		case parquet::format::Type::INT32:
+			if (!in_place) {
+				memcpy((int*) values + task.dest_offset, col.data.ptr,
+						nrows * sizeof(int));
+			}
+			break;
+		case parquet::format::Type::DOUBLE:
+			if (!in_place) {
+				memcpy((double*) values + task.dest_offset, col.data.ptr,
+						nrows * sizeof(double));
+			}
+			break;
+		case parquet::format::Type::BOOLEAN: {
+			auto src = (bool*) col.data.ptr;
+			auto dest_ptr = (int*) values + task.dest_offset;
+			for (uint64_t row_idx = 0; row_idx < nrows; row_idx++) {
+				dest_ptr[row_idx] = defined[row_idx] ? src[row_idx] : NA_LOGICAL;
+			}
+			break;
+		}
+		case parquet::format::Type::INT64: {
+			auto src = (int64_t*) col.data.ptr;
+			auto dest_ptr = (double*) values + task.dest_offset;
+			for (uint64_t row_idx = 0; row_idx < nrows; row_idx++) {
+				dest_ptr[row_idx] =
+						defined[row_idx] ? (double) src[row_idx] : NA_REAL;
+			}
+			break;
+		}
+		case parquet::format::Type::FLOAT: {
+			auto src = (float*) col.data.ptr;
+			auto dest_ptr = (double*) values + task.dest_offset;
+			for (uint64_t row_idx = 0; row_idx < nrows; row_idx++) {
+				dest_ptr[row_idx] =
+						defined[row_idx] ? (double) src[row_idx] : NA_REAL;
+			}
+			break;
+		}
+		case parquet::format::Type::INT96: {
+			auto src = (Int96*) col.data.ptr;
+			auto dest_ptr = (double*) values + task.dest_offset;
+			for (uint64_t row_idx = 0; row_idx < nrows; row_idx++) {
+				dest_ptr[row_idx] =
+						defined[row_idx] ?
+								impala_timestamp_to_nanoseconds(src[row_idx])
+										/ 1000000000 :
+								NA_REAL;
+			}
+			break;
+		}
+		case parquet::format::Type::FIXED_LEN_BYTE_ARRAY: {
+			// only DECIMAL gets here, see r_type()
+			auto& s_ele = col.col->schema_element;
+			auto src = (char**) col.data.ptr;
+			auto dest_ptr = (double*) values + task.dest_offset;
+			for (uint64_t row_idx = 0; row_idx < nrows; row_idx++) {
+				dest_ptr[row_idx] =
+						defined[row_idx] ?
+								decimal_to_double(src[row_idx], s_ele->type_length,
+										s_ele->scale) :
+								NA_REAL;
+			}
+			break;
+		}
+		case parquet::format::Type::BYTE_ARRAY:
+			break; // see convert_strings()
+		default:
+			throw runtime_error("Unsupported type in column " + col.col->name);
+		}
+	}
+}
+
+// the second half of decode_row_group(), writes the string and factor columns. Main thread only.
+static void convert_strings(const ScanTask &task, ResultChunk &rc,
+		const vector<RColumn> &columns) {
+	for (size_t col_idx = 0; col_idx < rc.cols.size(); col_idx++) {
+		auto& col = rc.cols[col_idx];
+		if (col.col->type != parquet::format::Type::BYTE_ARRAY) {
+			continue;
+		}
+		auto defined = col.defined.ptr;
+		auto src = (char**) col.data.ptr;
+		auto dict_indices = (uint32_t*) col.dict_indices.ptr;
+		auto factor = columns[col_idx].factor;
+		if (factor) {
+			// every dictionary entry is looked up once, 0 means not yet
+			vector<int> dict_codes(col.dictionary.size(), 0);
+			auto dest_ptr = (int*) columns[col_idx].values + task.dest_offset;
+			for (uint64_t row_idx = 0; row_idx < task.nrows; row_idx++) {
+				if (!defined[row_idx]) {
+					dest_ptr[row_idx] = NA_INTEGER;
+				} else if (dict_indices[row_idx] != ResultColumn::NO_DICT_INDEX) {
+					auto &code = dict_codes[dict_indices[row_idx]];
+					if (!code) {
+						code = factor->code(src[row_idx]);
+					}
+					dest_ptr[row_idx] = code;
+				} else {
+					dest_ptr[row_idx] = factor->code(src[row_idx]);
+				}
+			}
+			continue;
+		}
+		// rows from dictionary pages share one CHARSXP per dictionary entry, NA until it is created
+		SEXP dest = columns[col_idx].vec;
+		SEXP dict_chars = PROTECT(NEW_STRING(col.dictionary.size()));
+		// new character vectors are filled with "", not NA
+		for (size_t dict_idx = 0; dict_idx < col.dictionary.size(); dict_idx++) {
+			SET_STRING_ELT(dict_chars, dict_idx, NA_STRING);
+		}
+		for (uint64_t row_idx = 0; row_idx < task.nrows; row_idx++) {
+			SEXP item;
+			if (!defined[row_idx]) {
+				item = NA_STRING;
+			} else if (dict_indices[row_idx] != ResultColumn::NO_DICT_INDEX) {
+				item = STRING_ELT(dict_chars, dict_indices[row_idx]);
+				if (item == NA_STRING) {
+					item = mkCharCE(src[row_idx], CE_UTF8);
+					SET_STRING_ELT(dict_chars, dict_indices[row_idx], item);
+				}
+			} else {
+				item = mkCharCE(src[row_idx], CE_UTF8);
+			}
+			SET_STRING_ELT(dest, row_idx + task.dest_offset, item);
+		}
+		UNPROTECT(1); // dict_chars
+	}
+}
+
+static bool needs_main_thread(const vector<RColumn> &columns) {
+	for (auto &col : columns) {
+		if (TYPEOF(col.vec) == STRSXP || col.factor) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// runs task(0) ... task(n - 1) on up to threads threads. Tasks must not use the R API.
+// Returns the first error message, or an empty string if all tasks succeeded.
+static string parallel_for(size_t n, unsigned threads,
+		const function<void(size_t)> &task) {
+	atomic<size_t> next_task(0);
+	atomic<bool> failed(false);
+	string error;
+	mutex error_lock;
+	auto worker = [&]() {
+		size_t task_idx;
+		while (!failed && (task_idx = next_task++) < n) {
+			try {
+				task(task_idx);
+			} catch (std::exception &ex) {
+				lock_guard<mutex> guard(error_lock);
+				if (!failed) {
+					error = ex.what();
+					failed = true;
+				}
+			}
+		}
+	};
+	vector<thread> pool;
+	for (size_t i = 1; i < min<size_t>(threads, n); i++) {
+		pool.push_back(thread(worker));
+	}
+	worker();
+	for (auto &t : pool) {
+		t.join();
+	}
+	return error;
+}
+
+// worker threads decode row groups ahead of the main thread, which creates the strings and factor codes of
+// one row group after the other, in order so factor levels are too
+struct ScanPipeline {
+	ScanPipeline(const vector<ScanTask> &tasks_p,
+			const vector<uint64_t> &column_ids_p,
+			const vector<RColumn> &columns_p, unsigned threads) :
+			tasks(tasks_p), column_ids(column_ids_p), columns(columns_p), chunks(
+					tasks.size()) {
+		// bounds the decoded row groups that wait for the main thread
+		window = 2 * threads;
+		for (unsigned i = 0; i < min<size_t>(threads, tasks.size()); i++) {
+			pool.push_back(thread([this]() {
+				work();
+			}));
+		}
+	}
+
+	~ScanPipeline() {
+		stop();
+	}
+
+	void work() {
+		while (true) {
+			size_t task_idx;
+			{
+				unique_lock<mutex> guard(lock);
+				changed.wait(guard, [this]() {
+					return failed || next_task >= tasks.size()
+							|| next_task < converted + window;
+				});
+				if (failed || next_task >= tasks.size()) {
+					return;
+				}
+				task_idx = next_task++;
+			}
+			unique_ptr<ResultChunk> rc(new ResultChunk());
+			string task_error;
+			try {
+				initialize_r_result(*tasks[task_idx].file, *rc, column_ids);
+				decode_row_group(tasks[task_idx], *rc, columns);
+			} catch (std::exception &ex) {
+				task_error = ex.what();
+			}
+			lock_guard<mutex> guard(lock);
+			if (!task_error.empty()) {
+				if (!failed) {
+					error = task_error;
+				}
+				failed = true;
+			} else {
+				chunks[task_idx] = move(rc);
+			}
+			changed.notify_all();
+		}
+	}
+
+	// main thread, afterwards error has the first error if there was one
+	void run() {
+		for (size_t task_idx = 0; task_idx < tasks.size(); task_idx++) {
+			unique_ptr<ResultChunk> rc;
+			{
+				unique_lock<mutex> guard(lock);
+				changed.wait(guard, [&]() {
+					return failed || chunks[task_idx];
+				});
+				if (failed) {
+					break;
+				}
+				rc = move(chunks[task_idx]);
+			}
+			try {
+				convert_strings(tasks[task_idx], *rc, columns);
+			} catch (std::exception &ex) {
+				lock_guard<mutex> guard(lock);
+				error = ex.what();
+				break;
+			}
+			lock_guard<mutex> guard(lock);
+			converted++;
+			changed.notify_all();
+		}
+		stop();
+	}
+
+	void stop() {
+		{
+			lock_guard<mutex> guard(lock);
+			failed = failed || converted < tasks.size();
+			changed.notify_all();
+		}
+		for (auto &t : pool) {
+			t.join();
+		}
+		pool.clear();
+	}
+
+	const vector<ScanTask> &tasks;
+	const vector<uint64_t> &column_ids;
+	const vector<RColumn> &columns;
+	vector<unique_ptr<ResultChunk>> chunks;
+	size_t window;
+	vector<thread> pool;
+
+	mutex lock;
+	condition_variable changed;
+	size_t next_task = 0;
+	size_t converted = 0;
+	bool failed = false;
+	string error;
+};
+
+static SEXP run_pipeline(void *pipeline) {
+	((ScanPipeline*) pipeline)->run();
+	return R_NilValue;
+}
+
+// R errors while creating strings jump past any destructor, the workers are stopped before that
+static void stop_pipeline(void *pipeline, Rboolean jump) {
+	if (jump) {
+		((ScanPipeline*) pipeline)->stop();
+	}
+}
+
+// reads the given columns of the row groups in tasks, on up to threads threads
+static void read_tasks(const vector<ScanTask> &tasks,
+		const vector<uint64_t> &column_ids, const vector<RColumn> &columns,
+		unsigned threads) {
+	if (threads <= 1 || tasks.size() <= 1) {
+		ResultChunk rc;
+		ParquetFile *rc_file = nullptr;
+		for (auto &task : tasks) {
+			if (task.file != rc_file) {
+				initialize_r_result(*task.file, rc, column_ids);
+				rc_file = task.file;
+			}
+			decode_row_group(task, rc, columns);
+			convert_strings(task, rc, columns);
+		}
+		return;
+	}
+	if (!needs_main_thread(columns)) {
+		auto error = parallel_for(tasks.size(), threads, [&](size_t i) {
+			ResultChunk rc;
+			initialize_r_result(*tasks[i].file, rc, column_ids);
+			decode_row_group(tasks[i], rc, columns);
+		});
+		if (!error.empty()) {
+			throw runtime_error(error);
+		}
+		return;
+	}
+	SEXP cont = PROTECT(R_MakeUnwindCont());
+	ScanPipeline pipeline(tasks, column_ids, columns, threads);
+	R_UnwindProtect(run_pipeline, &pipeline, stop_pipeline, &pipeline, cont);
+	UNPROTECT(1); // cont
+	if (!pipeline.error.empty()) {
+		throw runtime_error(pipeline.error);
+	}
+}
+
+// files read together need the same columns in the same order
+static bool same_column(ParquetColumn &a, ParquetColumn &b) {
+	if (a.name != b.name || a.type != b.type) {
+		return false;
+	}
+	if (a.type == parquet::format::Type::FIXED_LEN_BYTE_ARRAY) {
+		return a.schema_element->type_length == b.schema_element->type_length
+				&& a.schema_element->scale == b.schema_element->scale;
+	}
+	return true;
+}
+
+// a column that is only read once R looks at its data. data1 of the ALTREP object is an external pointer to
+// the LazyColumn, whose protected value caches the last row group read for single elements and regions.
+// data2 is the full vector once something needs all of it.
+struct LazyColumn {
+	vector<shared_ptr<ParquetFile>> files;
+	uint64_t col_idx;
+	vector<ScanTask> tasks;
+	unsigned threads;
+	// first row of every task, followed by the row count
+	vector<uint64_t> row_group_starts;
+	int64_t cached_row_group = -1;
+};
+
+static R_altrep_class_t lazy_logical_class, lazy_integer_class,
+		lazy_real_class, lazy_string_class;
+
+static void lazy_column_finalize(SEXP ptr) {
+	delete (LazyColumn*) R_ExternalPtrAddr(ptr);
+	R_ClearExternalPtr(ptr);
+}
+
+static LazyColumn& lazy_column(SEXP x) {
+	return *(LazyColumn*) R_ExternalPtrAddr(R_altrep_data1(x));
+}
+
+static SEXP lazy_materialize(SEXP x) {
+	auto data2 = R_altrep_data2(x);
+	if (data2 != R_NilValue) {
+		return data2;
+	}
+	auto &col = lazy_column(x);
+	SEXP vec = PROTECT(
+			Rf_allocVector(r_type(*col.files[0]->columns[col.col_idx]),
+					col.row_group_starts.back()));
+	read_tasks(col.tasks, { col.col_idx }, { r_column(vec) }, col.threads);
+	R_set_altrep_data2(x, vec);
+	// the cached row group is not needed anymore
+	R_SetExternalPtrProtected(R_altrep_data1(x), R_NilValue);
+	UNPROTECT(1);
+	return vec;
+}
+
+// the values of the row group that contains row_idx, start is set to its first row
+static SEXP lazy_row_group(SEXP x, R_xlen_t row_idx, R_xlen_t &start) {
+	auto &col = lazy_column(x);
+	auto &starts = col.row_group_starts;
+	auto task_idx = upper_bound(starts.begin(), starts.end(),
+			(uint64_t) row_idx) - starts.begin() - 1;
+	start = starts[task_idx];
+	auto ptr = R_altrep_data1(x);
+	if (col.cached_row_group != task_idx) {
+		auto task = col.tasks[task_idx];
+		SEXP vec = PROTECT(
+				Rf_allocVector(r_type(*task.file->columns[col.col_idx]),
+						task.nrows));
+		task.dest_offset = 0;
+		read_tasks( { task }, { col.col_idx }, { r_column(vec) }, 1);
+		R_SetExternalPtrProtected(ptr, vec);
+		col.cached_row_group = task_idx;
+		UNPROTECT(1);
+	}
+	return R_ExternalPtrProtected(ptr);
+}
+
+static R_xlen_t lazy_length(SEXP x) {
+	return lazy_column(x).row_group_starts.back();
+}
+
+static void* lazy_dataptr(SEXP x, Rboolean writeable) {
+	try {
+		auto vec = lazy_materialize(x);
+		return TYPEOF(vec) == STRSXP ? (void*) STRING_PTR_RO(vec) : r_values(vec);
+	} catch (std::exception &ex) {
+		Rf_error("%s", ex.what());
+	}
+}
+
+static const void* lazy_dataptr_or_null(SEXP x) {
+	auto vec = R_altrep_data2(x);
+	if (vec == R_NilValue) {
+		return nullptr;
+	}
+	return TYPEOF(vec) == STRSXP ? (void*) STRING_PTR_RO(vec) : r_values(vec);
+}
+
+template<class T>
+static T lazy_elt(SEXP x, R_xlen_t i) {
+	try {
+		auto vec = R_altrep_data2(x);
+		R_xlen_t start = 0;
+		if (vec == R_NilValue) {
+			vec = lazy_row_group(x, i, start);
+		}
+		return ((T*) r_values(vec))[i - start];
+	} catch (std::exception &ex) {
+		Rf_error("%s", ex.what());
+	}
+}
 
-SEXP miniparquet_read(SEXP filesxp) {
+template<class T>
+static R_xlen_t lazy_get_region(SEXP x, R_xlen_t i, R_xlen_t n, T *buf) {
+	try {
+		auto len = lazy_length(x);
+		if (i >= len) {
+			return 0;
+		}
+		n = min(n, len - i);
+		auto vec = R_altrep_data2(x);
+		if (vec != R_NilValue) {
+			memcpy(buf, (T*) r_values(vec) + i, n * sizeof(T));
+			return n;
+		}
+		// only read the row groups the region overlaps
+		R_xlen_t done = 0;
+		while (done < n) {
+			R_xlen_t start;
+			vec = lazy_row_group(x, i + done, start);
+			auto offset = i + done - start;
+			auto count = min(n - done, XLENGTH(vec) - offset);
+			memcpy(buf + done, (T*) r_values(vec) + offset, count * sizeof(T));
+			done += count;
+		}
+		return n;
+	} catch (std::exception &ex) {
+		Rf_error("%s", ex.what());
+	}
+}
 
-	if (TYPEOF(filesxp) != STRSXP || LENGTH(filesxp) != 1) {
-		Rf_error("miniparquet_read: Need single filename parameter");
+static SEXP lazy_string_elt(SEXP x, R_xlen_t i) {
+	try {
+		auto vec = R_altrep_data2(x);
+		R_xlen_t start = 0;
+		if (vec == R_NilValue) {
+			vec = lazy_row_group(x, i, start);
+		}
+		return STRING_ELT(vec, i - start);
+	} catch (std::exception &ex) {
+		Rf_error("%s", ex.what());
 	}
+}
 
+static void lazy_string_set_elt(SEXP x, R_xlen_t i, SEXP v) {
 	try {
-		// parse the query and transform it into a set of statements
+		SET_STRING_ELT(lazy_materialize(x), i, v);
+	} catch (std::exception &ex) {
+		Rf_error("%s", ex.what());
+	}
+}
 
-		char *fname = (char *) CHAR(STRING_ELT(filesxp, 0));
+static void register_lazy_class(R_altrep_class_t cls) {
+	R_set_altrep_Length_method(cls, lazy_length);
+	R_set_altvec_Dataptr_method(cls, lazy_dataptr);
+	R_set_altvec_Dataptr_or_null_method(cls, lazy_dataptr_or_null);
+}
 
-		ParquetFile f(fname);
+static void register_lazy_classes(DllInfo *dll) {
+#if R_VERSION >= R_Version(3, 6, 0)
+	lazy_logical_class = R_make_altlogical_class("miniparquet_lazy_logical",
+			"miniparquet", dll);
+	register_lazy_class(lazy_logical_class);
+	R_set_altlogical_Elt_method(lazy_logical_class, lazy_elt<int>);
+	R_set_altlogical_Get_region_method(lazy_logical_class,
+			lazy_get_region<int>);
+#endif
+	lazy_integer_class = R_make_altinteger_class("miniparquet_lazy_integer",
+			"miniparquet", dll);
+	register_lazy_class(lazy_integer_class);
+	R_set_altinteger_Elt_method(lazy_integer_class, lazy_elt<int>);
+	R_set_altinteger_Get_region_method(lazy_integer_class,
+			lazy_get_region<int>);
+
+	lazy_real_class = R_make_altreal_class("miniparquet_lazy_real",
+			"miniparquet", dll);
+	register_lazy_class(lazy_real_class);
+	R_set_altreal_Elt_method(lazy_real_class, lazy_elt<double>);
+	R_set_altreal_Get_region_method(lazy_real_class, lazy_get_region<double>);
+
+	lazy_string_class = R_make_altstring_class("miniparquet_lazy_string",
+			"miniparquet", dll);
+	register_lazy_class(lazy_string_class);
+	R_set_altstring_Elt_method(lazy_string_class, lazy_string_elt);
+	R_set_altstring_Set_elt_method(lazy_string_class, lazy_string_set_elt);
+}
+
+// a lazy column of the row groups in tasks, input is kept alive as long as the column if it is a raw vector the
+// files read from. Returns nullptr if this R has no ALTREP class for the column type.
+static SEXP new_lazy_column(const vector<shared_ptr<ParquetFile>> &files,
+		const vector<ScanTask> &tasks, uint64_t nrows, SEXP input,
+		uint64_t col_idx, unsigned threads) {
+	R_altrep_class_t cls;
+	switch (r_type(*files[0]->columns[col_idx])) {
+	case LGLSXP:
+#if R_VERSION >= R_Version(3, 6, 0)
+		cls = lazy_logical_class;
+		break;
+#else
+		return nullptr;
+#endif
+	case INTSXP:
+		cls = lazy_integer_class;
+		break;
+	case REALSXP:
+		cls = lazy_real_class;
+		break;
+	default:
+		cls = lazy_string_class;
+		break;
+	}
+
+	unique_ptr<LazyColumn> col(new LazyColumn());
+	col->files = files;
+	col->col_idx = col_idx;
+	col->tasks = tasks;
+	col->threads = threads;
+	for (auto &task : tasks) {
+		col->row_group_starts.push_back(task.dest_offset);
+	}
+	col->row_group_starts.push_back(nrows);
+
+	SEXP ptr = PROTECT(R_MakeExternalPtr(col.get(), input, R_NilValue));
+	R_RegisterCFinalizerEx(ptr, lazy_column_finalize, TRUE);
+	col.release();
+	SEXP res = PROTECT(R_new_altrep(cls, ptr, R_NilValue));
+	UNPROTECT(2);
+	return res;
+}
+
+// the indices of the columns col_select names or numbers (from 1), all of them if it is NULL
+static vector<uint64_t> select_columns(ParquetFile &f, SEXP col_select) {
+	vector<uint64_t> column_ids;
+	if (Rf_isNull(col_select)) {
+		for (uint64_t col_idx = 0; col_idx < f.columns.size(); col_idx++) {
+			column_ids.push_back(col_idx);
+		}
+	} else if (TYPEOF(col_select) == STRSXP) {
+		for (R_xlen_t i = 0; i < XLENGTH(col_select); i++) {
+			string name = CHAR(STRING_ELT(col_select, i));
+			uint64_t col_idx = 0;
+			while (col_idx < f.columns.size()
+					&& f.columns[col_idx]->name != name) {
+				col_idx++;
+			}
+			if (col_idx == f.columns.size()) {
+				throw runtime_error("miniparquet_read: Unknown column " + name);
+			}
+			column_ids.push_back(col_idx);
+		}
+	} else if (TYPEOF(col_select) == INTSXP || TYPEOF(col_select) == REALSXP) {
+		for (R_xlen_t i = 0; i < XLENGTH(col_select); i++) {
+			double idx =
+					TYPEOF(col_select) == INTSXP ?
+							INTEGER(col_select)[i] : REAL(col_select)[i];
+			if (!(idx >= 1 && idx <= f.columns.size())) {
+				throw runtime_error("miniparquet_read: Column index out of range");
+			}
+			column_ids.push_back((uint64_t) idx - 1);
+		}
+	} else {
+		throw runtime_error(
+				"miniparquet_read: col_select needs column names or numbers");
+	}
+	return column_ids;
+}
+
+extern "C" {
+
+SEXP miniparquet_read(SEXP filesxp, SEXP lazysxp, SEXP factorsxp,
+		SEXP col_select, SEXP n_maxsxp, SEXP threadsxp) {
+
+	if ((TYPEOF(filesxp) != STRSXP || LENGTH(filesxp) < 1)
+			&& TYPEOF(filesxp) != RAWSXP) {
+		Rf_error(
+				"miniparquet_read: Need filenames or raw vector parameter");
+	}
+	bool lazy = Rf_asLogical(lazysxp) == TRUE;
+	bool as_factor = Rf_asLogical(factorsxp) == TRUE;
+	double n_max = Rf_asReal(n_maxsxp);
+	int threads = Rf_asInteger(threadsxp);
+	if (threads == NA_INTEGER || threads < 1) {
+		Rf_error("miniparquet_read: threads must be at least 1");
+	}
+
+	try {
+		// the footers are read and parsed in parallel for several files
+		vector<shared_ptr<ParquetFile>> files;
+		if (TYPEOF(filesxp) == RAWSXP) {
+			// read straight from the vector, it is protected as an argument of this call
+			// and by the external pointers of lazy columns
+			files.push_back(
+					shared_ptr<ParquetFile>(
+							new ParquetFile((const char*) RAW(filesxp),
+									XLENGTH(filesxp))));
+		} else {
+			vector<string> fnames;
+			for (R_xlen_t i = 0; i < XLENGTH(filesxp); i++) {
+				fnames.push_back(CHAR(STRING_ELT(filesxp, i)));
+			}
+			files.resize(fnames.size());
+			auto error = parallel_for(fnames.size(), threads, [&](size_t i) {
+				files[i] = shared_ptr<ParquetFile>(new ParquetFile(fnames[i]));
+			});
+			if (!error.empty()) {
+				throw runtime_error(error);
+			}
+		}
+		auto &f = *files[0];
+		for (auto &other : files) {
+			if (other->columns.size() != f.columns.size()) {
+				throw runtime_error(
+						"miniparquet_read: Files have different numbers of columns");
+			}
+			for (size_t col_idx = 0; col_idx < f.columns.size(); col_idx++) {
+				if (!same_column(*other->columns[col_idx], *f.columns[col_idx])) {
+					throw runtime_error(
+							"miniparquet_read: Files have different types for column "
+									+ f.columns[col_idx]->name);
+				}
+			}
+		}
+		auto column_ids = select_columns(f, col_select);
+		uint64_t nrows;
+		auto tasks = plan_scan(files, n_max, nrows);
 
 		// allocate vectors
 
-		auto ncols = f.columns.size();
-		auto nrows = f.nrow;
+		auto ncols = column_ids.size();
 
 		SEXP retlist = PROTECT(NEW_LIST(ncols));
 		if (!retlist) {
@@ -60,242 +935,63 @@ SEXP miniparquet_read(SEXP filesxp) {
 		}
 		SET_NAMES(retlist, names);
 		UNPROTECT(1); // names
-
-		for (size_t col_idx = 0; col_idx < ncols; col_idx++) {
-			SEXP varname = PROTECT(
-					mkCharCE(f.columns[col_idx]->name.c_str(), CE_UTF8));
+		// the row count, for the row names of the data.frame even if no columns are selected
+		setAttrib(retlist, install("nrows"), PROTECT(Rf_ScalarReal(nrows)));
+		UNPROTECT(1);
+
+		vector<uint64_t> eager_ids;
+		vector<RColumn> eager_columns;
+		vector<unique_ptr<FactorLevels>> factors;
+		for (size_t result_idx = 0; result_idx < ncols; result_idx++) {
+			auto col_idx = column_ids[result_idx];
+			auto &pcol = *f.columns[col_idx];
+			SEXP varname = PROTECT(mkCharCE(pcol.name.c_str(), CE_UTF8));
 			if (!varname) {
 				UNPROTECT(2); // varname, retlist
 				Rf_error("miniparquet_read: Memory allocation failed");
 			}
-			SET_STRING_ELT(names, col_idx, varname);
+			SET_STRING_ELT(names, result_idx, varname);
 			UNPROTECT(1); // varname
 
-			SEXP varvalue = NULL;
-			switch (f.columns[col_idx]->type) {
-			case parquet::format::Type::BOOLEAN:
-				varvalue = PROTECT(NEW_LOGICAL(nrows));
-				break;
-			case parquet::format::Type::INT32:
-				varvalue = PROTECT(NEW_INTEGER(nrows));
-				break;
-			case parquet::format::Type::INT64:
-			case parquet::format::Type::DOUBLE:
-			case parquet::format::Type::FLOAT:
-				varvalue = PROTECT(NEW_NUMERIC(nrows));
-				break;
-			case parquet::format::Type::INT96: {
-				varvalue = PROTECT(NEW_NUMERIC(nrows));
-				SEXP cl = PROTECT(NEW_STRING(2));
-				SET_STRING_ELT(cl, 0, PROTECT(mkChar("POSIXct")));
-				SET_STRING_ELT(cl, 1, PROTECT(mkChar("POSIXt")));
-				SET_CLASS(varvalue, cl);
-				setAttrib(varvalue, install("tzone"), PROTECT(mkString("UTC")));
-				UNPROTECT(4);
-				break;
-			}
-			case parquet::format::Type::FIXED_LEN_BYTE_ARRAY: { // oof
-				auto& s_ele = f.columns[col_idx]->schema_element;
-				if (!s_ele->__isset.converted_type) {
-					throw runtime_error("Missing FLBA type");
-				}
-				switch (s_ele->converted_type) {
-				case parquet::format::ConvertedType::DECIMAL:
-					varvalue = PROTECT(NEW_NUMERIC(nrows));
-					break;
-				default:
-					UNPROTECT(1); // retlist
-					auto it =
-							parquet::format::_ConvertedType_VALUES_TO_NAMES.find(
-									s_ele->converted_type);
-					Rf_error("miniparquet_read: Unknown FLBA type %s",
-							it->second);
-				}
-				break;
-			}
-			case parquet::format::Type::BYTE_ARRAY:
-				varvalue = PROTECT(NEW_STRING(nrows));
-				break;
-			default:
-				UNPROTECT(1); // retlist
-				auto it = parquet::format::_Type_VALUES_TO_NAMES.find(
-						f.columns[col_idx]->type);
-				Rf_error("miniparquet_read: Unknown column type %s",
-						it->second); // unlikely
-			}
+			// factor levels depend on all rows, those columns are never lazy
+			bool factor = as_factor
+					&& pcol.type == parquet::format::Type::BYTE_ARRAY;
+			SEXP varvalue =
+					lazy && !factor ?
+							new_lazy_column(files, tasks, nrows, filesxp,
+									col_idx, threads) :
+							nullptr;
 			if (!varvalue) {
-				UNPROTECT(2); // varvalue, retlist
-				Rf_error("miniparquet_read: Memory allocation failed");
+				varvalue = NEW_VECTOR_OF(factor ? INTSXP : r_type(pcol), nrows);
+				if (factor) {
+					factors.emplace_back(new FactorLevels());
+				}
+				eager_ids.push_back(col_idx);
+				eager_columns.push_back(
+						r_column(varvalue,
+								factor ? factors.back().get() : nullptr));
 			}
-			SET_VECTOR_ELT(retlist, col_idx, varvalue);
+			PROTECT(varvalue);
+			set_column_class(pcol, varvalue);
+			SET_VECTOR_ELT(retlist, result_idx, varvalue);
 			UNPROTECT(1); /* varvalue */
 		}
 
 		// at this point retlist is fully allocated and the only protected SEXP
-
-		ResultChunk rc;
-		ScanState s;
-
-		f.initialize_result(rc);
-		uint64_t dest_offset = 0;
-
-		while (f.scan(s, rc)) {
-			for (size_t col_idx = 0; col_idx < ncols; col_idx++) {
-				auto& col = rc.cols[col_idx];
-				SEXP dest = VECTOR_ELT(retlist, col_idx);
-
-				for (uint64_t row_idx = 0; row_idx < rc.nrows; row_idx++) {
-					if (!col.defined.ptr[row_idx]) {
-
-						// NULLs
-						switch (f.columns[col_idx]->type) {
-						case parquet::format::Type::BOOLEAN:
-							LOGICAL_POINTER(dest)[row_idx + dest_offset] =
-									NA_LOGICAL;
-							break;
-						case parquet::format::Type::INT32:
-							INTEGER_POINTER(dest)[row_idx + dest_offset] =
-									NA_INTEGER;
-							break;
-						case parquet::format::Type::INT64:
-						case parquet::format::Type::DOUBLE:
-						case parquet::format::Type::FLOAT:
-						case parquet::format::Type::INT96:
-							NUMERIC_POINTER(dest)[row_idx + dest_offset] =
-									NA_REAL;
-							break;
-						case parquet::format::Type::FIXED_LEN_BYTE_ARRAY: { // oof, TODO duplication above
-							auto& s_ele = f.columns[col_idx]->schema_element;
-							if (!s_ele->__isset.converted_type) {
-								throw runtime_error("Missing FLBA type");
-							}
-							switch (s_ele->converted_type) {
-							case parquet::format::ConvertedType::DECIMAL:
-								NUMERIC_POINTER(dest)[row_idx + dest_offset] =
-										NA_REAL;
-								break;
-							default:
-								UNPROTECT(1); // retlist
-								auto it =
-										parquet::format::_ConvertedType_VALUES_TO_NAMES.find(
-												s_ele->converted_type);
-								Rf_error(
-										"miniparquet_read: Unknown FLBA type %s",
-										it->second);
-							}
-							break;
-						}
-						case parquet::format::Type::BYTE_ARRAY:
-							SET_STRING_ELT(dest, row_idx + dest_offset,
-									NA_STRING);
-
-							break;
-
-						default: {
-							UNPROTECT(1); // retlist
-							auto it =
-									parquet::format::_Type_VALUES_TO_NAMES.find(
-											f.columns[col_idx]->type);
-							Rf_error("miniparquet_read: Unknown column type %s",
-									it->second); // unlikely
-						}
-						}
-						continue;
-					}
-
-					switch (f.columns[col_idx]->type) {
-					case parquet::format::Type::BOOLEAN:
-						LOGICAL_POINTER(dest)[row_idx + dest_offset] =
-								((bool*) col.data.ptr)[row_idx];
-						break;
-					case parquet::format::Type::INT32:
-						INTEGER_POINTER(dest)[row_idx + dest_offset] =
-								((int32_t*) col.data.ptr)[row_idx];
-						break;
-					case parquet::format::Type::INT64:
-						NUMERIC_POINTER(dest)[row_idx + dest_offset] =
-								(double) ((int64_t*) col.data.ptr)[row_idx];
-						break;
-					case parquet::format::Type::DOUBLE:
-						NUMERIC_POINTER(dest)[row_idx + dest_offset] =
-								((double*) col.data.ptr)[row_idx];
-						break;
-					case parquet::format::Type::FLOAT:
-						NUMERIC_POINTER(dest)[row_idx + dest_offset] =
-								(double) ((float*) col.data.ptr)[row_idx];
-						break;
-					case parquet::format::Type::INT96:
-						NUMERIC_POINTER(dest)[row_idx + dest_offset] =
-								impala_timestamp_to_nanoseconds(
-										((Int96*) col.data.ptr)[row_idx])
-										/ 1000000000;
-						break;
-
-					case parquet::format::Type::FIXED_LEN_BYTE_ARRAY: { // oof, TODO clusterfuck
-						auto& s_ele = f.columns[col_idx]->schema_element;
-						if (!s_ele->__isset.converted_type) {
-							throw runtime_error("Missing FLBA type");
-						}
-						switch (s_ele->converted_type) {
-						case parquet::format::ConvertedType::DECIMAL:
-
-						{
-
-							// this is a giant clusterfuck
-							auto type_len = s_ele->type_length;
-							auto bytes =((char**)col.data.ptr)[row_idx];
-							int64_t val = 0;
-							for (auto i = 0; i < type_len; i++) {
-								val = val << ((type_len - i) * 8)
-										| (uint8_t) bytes[i];
-							}
-
-							NUMERIC_POINTER(dest)[row_idx + dest_offset] = val
-									/ pow(10.0, s_ele->scale);
-
-						}
-
-							break;
-						default:
-							UNPROTECT(1); // retlist
-							auto it =
-									parquet::format::_ConvertedType_VALUES_TO_NAMES.find(
-											s_ele->converted_type);
-							Rf_error("miniparquet_read: Unknown FLBA type %s",
-									it->second);
-						}
-						break;
-					}
-
-					case parquet::format::Type::BYTE_ARRAY:
-						SET_STRING_ELT(dest, row_idx + dest_offset,
-								mkCharCE(
-										((char**)col.data.ptr)[row_idx],
-										CE_UTF8));
-						break;
-
-					default: {
-						auto it = parquet::format::_Type_VALUES_TO_NAMES.find(
-								f.columns[col_idx]->type);
-						UNPROTECT(1); // retlist
-						Rf_error("miniparquet_read: Unknown column type %s",
-								it->second); // unlikely
-					}
-					}
-
-				}
-
+		if (!eager_ids.empty()) {
+			read_tasks(tasks, eager_ids, eager_columns, threads);
+		}
+		for (auto &col : eager_columns) {
+			if (col.factor) {
+				set_factor_levels(*col.factor, col.vec);
 			}
-			dest_offset += rc.nrows;
-
 		}
-		assert(dest_offset == nrows);
 		UNPROTECT(1); // retlist
 		return retlist;
 
 
 	} catch (std::exception &ex) {
-		Rf_error(ex.what());
+		Rf_error("%s", ex.what());
 		// TODO this may leak
 	}
 
@@ -304,12 +1000,13 @@ SEXP miniparquet_read(SEXP filesxp) {
 // R native routine registration
 #define CALLDEF(name, n)                                                                                               \
 	{ #name, (DL_FUNC)&name, n }
-static const R_CallMethodDef R_CallDef[] = { CALLDEF(miniparquet_read, 1),
+static const R_CallMethodDef R_CallDef[] = { CALLDEF(miniparquet_read, 6),
 
 { NULL, NULL, 0 } };
 
 void R_init_miniparquet(DllInfo *dll) {
 	R_registerRoutines(dll, NULL, R_CallDef, NULL, NULL);
 	R_useDynamicSymbols(dll, FALSE);
+	register_lazy_classes(dll);
 }
 }
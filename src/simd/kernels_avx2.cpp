@@ -0,0 +1,153 @@
+#include "simd.h"
+
+#include <cstring>
+
+#ifdef MINIPARQUET_SIMD_X86
+#include <immintrin.h>
+
+#define TARGET __attribute__((target("avx2,bmi2,popcnt")))
+
+using namespace miniparquet::simd;
+
+TARGET static uint64_t count_zeros_avx2(const uint8_t *bytes, uint64_t n) {
+	const __m256i zero = _mm256_setzero_si256();
+	uint64_t res = 0;
+	uint64_t i = 0;
+	for (; i + 32 <= n; i += 32) {
+		auto v = _mm256_loadu_si256((const __m256i*) (bytes + i));
+		res += _mm_popcnt_u32(
+				(uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero)));
+	}
+	return res + count_zeros_generic(bytes + i, n - i);
+}
+
+TARGET static bool is_ascii_avx2(const uint8_t *bytes, uint64_t n) {
+	__m256i high = _mm256_setzero_si256();
+	uint64_t i = 0;
+	for (; i + 32 <= n; i += 32) {
+		high = _mm256_or_si256(high,
+				_mm256_loadu_si256((const __m256i*) (bytes + i)));
+	}
+	return _mm256_movemask_epi8(high) == 0 && is_ascii_generic(bytes + i, n - i);
+}
+
+// like the SSE version, with 32 flags at a time
+TARGET static void unpack_bits_avx2(const uint8_t *src, uint64_t n,
+		uint8_t *dst) {
+	const __m256i shuffle = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1,
+			1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+	const __m256i bits = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4,
+			8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32,
+			64, -128);
+	const __m256i one = _mm256_set1_epi8(1);
+	uint64_t i = 0;
+	for (; i + 32 <= n; i += 32) {
+		uint32_t word;
+		memcpy(&word, src + i / 8, sizeof(word));
+		auto v = _mm256_shuffle_epi8(_mm256_set1_epi32(word), shuffle);
+		v = _mm256_cmpeq_epi8(_mm256_and_si256(v, bits), bits);
+		_mm256_storeu_si256((__m256i*) (dst + i), _mm256_and_si256(v, one));
+	}
+	unpack_bits_generic(src + i / 8, n - i, dst + i);
+}
+
+// eight values at a time: eight values of bit_width bits take exactly bit_width bytes, so the
+// offsets of the values within a group are the same for every group. Each lane loads the 32 bits
+// around its value and shifts it into place, which works up to 25 bits.
+TARGET static void unpack32_avx2(const uint8_t *src, uint32_t bit_width,
+		uint64_t n, uint32_t *dst) {
+	if (bit_width == 0 || bit_width > 25) {
+		unpack32_generic(src, bit_width, n, dst);
+		return;
+	}
+	const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	const __m256i bit_offsets = _mm256_mullo_epi32(lanes,
+			_mm256_set1_epi32(bit_width));
+	const __m256i byte_offsets = _mm256_srli_epi32(bit_offsets, 3);
+	const __m256i shifts = _mm256_and_si256(bit_offsets, _mm256_set1_epi32(7));
+	const __m256i mask = _mm256_set1_epi32((1u << bit_width) - 1);
+
+	// the last lane reads four bytes, they have to be within the packed values
+	const uint64_t src_len = (n * bit_width + 7) / 8;
+	const uint64_t group_reads = (7 * bit_width) / 8 + 4;
+	uint64_t i = 0;
+	uint64_t pos = 0;
+	for (; i + 8 <= n && pos + group_reads <= src_len; i += 8, pos +=
+			bit_width) {
+		auto v = _mm256_i32gather_epi32((const int* ) (src + pos),
+				byte_offsets, 1);
+		v = _mm256_and_si256(_mm256_srlv_epi32(v, shifts), mask);
+		_mm256_storeu_si256((__m256i*) (dst + i), v);
+	}
+	unpack32_generic(src + pos, bit_width, n - i, dst + i);
+}
+
+TARGET static bool gather32_avx2(const uint32_t *dict, uint64_t dict_size,
+		const uint32_t *idx, const uint8_t *defined, uint64_t n, uint32_t *dst) {
+	if (dict_size == 0 || dict_size > UINT32_MAX) {
+		return gather32_generic(dict, dict_size, idx, defined, n, dst);
+	}
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i max_idx = _mm256_set1_epi32((uint32_t) (dict_size - 1));
+	uint64_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		uint64_t defined8;
+		memcpy(&defined8, defined + i, sizeof(defined8));
+		auto valid = _mm256_cmpgt_epi32(
+				_mm256_cvtepu8_epi32(_mm_cvtsi64_si128(defined8)), zero);
+		auto ids = _mm256_loadu_si256((const __m256i*) (idx + i));
+		auto in_range = _mm256_cmpeq_epi32(_mm256_min_epu32(ids, max_idx), ids);
+		if (!_mm256_testc_si256(in_range, valid)) {
+			return false;
+		}
+		// undefined lanes may hold any index, they must not be loaded
+		auto values = _mm256_mask_i32gather_epi32(zero, (const int* ) dict, ids,
+				valid, 4);
+		_mm256_storeu_si256((__m256i*) (dst + i), values);
+	}
+	return gather32_generic(dict, dict_size, idx + i, defined + i, n - i,
+			dst + i);
+}
+
+TARGET static bool gather64_avx2(const uint64_t *dict, uint64_t dict_size,
+		const uint32_t *idx, const uint8_t *defined, uint64_t n, uint64_t *dst) {
+	if (dict_size == 0 || dict_size > UINT32_MAX) {
+		return gather64_generic(dict, dict_size, idx, defined, n, dst);
+	}
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i max_idx = _mm_set1_epi32((uint32_t) (dict_size - 1));
+	uint64_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		uint32_t defined4;
+		memcpy(&defined4, defined + i, sizeof(defined4));
+		auto defined_bytes = _mm_cvtsi32_si128(defined4);
+		auto valid = _mm_cmpgt_epi32(_mm_cvtepu8_epi32(defined_bytes), zero);
+		auto ids = _mm_loadu_si128((const __m128i*) (idx + i));
+		auto in_range = _mm_cmpeq_epi32(_mm_min_epu32(ids, max_idx), ids);
+		if (!_mm_testc_si128(in_range, valid)) {
+			return false;
+		}
+		auto valid64 = _mm256_cvtepi32_epi64(valid);
+		auto values = _mm256_mask_i32gather_epi64(_mm256_setzero_si256(),
+				(const long long* ) dict, ids, valid64, 8);
+		_mm256_storeu_si256((__m256i*) (dst + i), values);
+	}
+	return gather64_generic(dict, dict_size, idx + i, defined + i, n - i,
+			dst + i);
+}
+
+void miniparquet::simd::add_avx2_kernels(Kernels &kernels) {
+	kernels.count_zeros = count_zeros_avx2;
+	kernels.is_ascii = is_ascii_avx2;
+	kernels.unpack_bits = unpack_bits_avx2;
+	kernels.unpack32 = unpack32_avx2;
+	kernels.gather32 = gather32_avx2;
+	kernels.gather64 = gather64_avx2;
+}
+
+#else
+
+void miniparquet::simd::add_avx2_kernels(Kernels &kernels) {
+}
+
+#endif
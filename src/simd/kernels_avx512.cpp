@@ -0,0 +1,119 @@
+#include "simd.h"
+
+#include <cstring>
+
+#ifdef MINIPARQUET_SIMD_X86
+#include <immintrin.h>
+
+// the AVX-512 intrinsics of some GCC versions trip this on their own placeholder values
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+#define TARGET __attribute__((target("avx512f,avx512bw,avx2,bmi2,popcnt")))
+
+using namespace miniparquet::simd;
+
+TARGET static uint64_t count_zeros_avx512(const uint8_t *bytes, uint64_t n) {
+	const __m512i zero = _mm512_setzero_si512();
+	uint64_t res = 0;
+	uint64_t i = 0;
+	for (; i + 64 <= n; i += 64) {
+		auto v = _mm512_loadu_si512((const void*) (bytes + i));
+		res += _mm_popcnt_u64(_mm512_cmpeq_epi8_mask(v, zero));
+	}
+	return res + count_zeros_generic(bytes + i, n - i);
+}
+
+// see unpack32_avx2, with 16 values per group
+TARGET static void unpack32_avx512(const uint8_t *src, uint32_t bit_width,
+		uint64_t n, uint32_t *dst) {
+	if (bit_width == 0 || bit_width > 25) {
+		unpack32_generic(src, bit_width, n, dst);
+		return;
+	}
+	const __m512i lanes = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10,
+			11, 12, 13, 14, 15);
+	const __m512i bit_offsets = _mm512_mullo_epi32(lanes,
+			_mm512_set1_epi32(bit_width));
+	const __m512i byte_offsets = _mm512_srli_epi32(bit_offsets, 3);
+	const __m512i shifts = _mm512_and_si512(bit_offsets, _mm512_set1_epi32(7));
+	const __m512i mask = _mm512_set1_epi32((1u << bit_width) - 1);
+
+	const uint64_t src_len = (n * bit_width + 7) / 8;
+	const uint64_t group_reads = (15 * bit_width) / 8 + 4;
+	uint64_t i = 0;
+	uint64_t pos = 0;
+	for (; i + 16 <= n && pos + group_reads <= src_len; i += 16, pos += 2
+			* bit_width) {
+		auto v = _mm512_i32gather_epi32(byte_offsets, (const void* ) (src + pos),
+				1);
+		v = _mm512_and_si512(_mm512_srlv_epi32(v, shifts), mask);
+		_mm512_storeu_si512((void*) (dst + i), v);
+	}
+	unpack32_generic(src + pos, bit_width, n - i, dst + i);
+}
+
+TARGET static bool gather32_avx512(const uint32_t *dict, uint64_t dict_size,
+		const uint32_t *idx, const uint8_t *defined, uint64_t n, uint32_t *dst) {
+	if (dict_size == 0 || dict_size > UINT32_MAX) {
+		return gather32_generic(dict, dict_size, idx, defined, n, dst);
+	}
+	const __m512i zero = _mm512_setzero_si512();
+	const __m512i max_idx = _mm512_set1_epi32((uint32_t) (dict_size - 1));
+	uint64_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		auto defined32 = _mm512_cvtepu8_epi32(
+				_mm_loadu_si128((const __m128i*) (defined + i)));
+		__mmask16 valid = _mm512_test_epi32_mask(defined32, defined32);
+		auto ids = _mm512_loadu_si512((const void*) (idx + i));
+		if (_mm512_mask_cmpgt_epu32_mask(valid, ids, max_idx)) {
+			return false;
+		}
+		auto values = _mm512_mask_i32gather_epi32(zero, valid, ids,
+				(const void* ) dict, 4);
+		_mm512_storeu_si512((void*) (dst + i), values);
+	}
+	return gather32_generic(dict, dict_size, idx + i, defined + i, n - i,
+			dst + i);
+}
+
+TARGET static bool gather64_avx512(const uint64_t *dict, uint64_t dict_size,
+		const uint32_t *idx, const uint8_t *defined, uint64_t n, uint64_t *dst) {
+	if (dict_size == 0 || dict_size > UINT32_MAX) {
+		return gather64_generic(dict, dict_size, idx, defined, n, dst);
+	}
+	const __m512i zero = _mm512_setzero_si512();
+	const __m256i max_idx = _mm256_set1_epi32((uint32_t) (dict_size - 1));
+	uint64_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		uint64_t defined8;
+		memcpy(&defined8, defined + i, sizeof(defined8));
+		auto defined32 = _mm256_cvtepu8_epi32(_mm_cvtsi64_si128(defined8));
+		// no 256 bit mask compares without AVX-512VL, check like the AVX2 version
+		auto valid = _mm256_cmpgt_epi32(defined32, _mm256_setzero_si256());
+		auto ids = _mm256_loadu_si256((const __m256i*) (idx + i));
+		auto in_range = _mm256_cmpeq_epi32(_mm256_min_epu32(ids, max_idx), ids);
+		if (!_mm256_testc_si256(in_range, valid)) {
+			return false;
+		}
+		__mmask8 valid_mask = _mm256_movemask_ps(_mm256_castsi256_ps(valid));
+		auto values = _mm512_mask_i32gather_epi64(zero, valid_mask, ids,
+				(const void* ) dict, 8);
+		_mm512_storeu_si512((void*) (dst + i), values);
+	}
+	return gather64_generic(dict, dict_size, idx + i, defined + i, n - i,
+			dst + i);
+}
+
+void miniparquet::simd::add_avx512_kernels(Kernels &kernels) {
+	kernels.count_zeros = count_zeros_avx512;
+	kernels.unpack32 = unpack32_avx512;
+	kernels.gather32 = gather32_avx512;
+	kernels.gather64 = gather64_avx512;
+}
+
+#else
+
+void miniparquet::simd::add_avx512_kernels(Kernels &kernels) {
+}
+
+#endif
@@ -0,0 +1,62 @@
+#include "simd.h"
+
+#include <cstring>
+
+#ifdef MINIPARQUET_SIMD_X86
+#include <nmmintrin.h>
+
+#define TARGET __attribute__((target("sse4.2,popcnt")))
+
+using namespace miniparquet::simd;
+
+TARGET static uint64_t count_zeros_sse42(const uint8_t *bytes, uint64_t n) {
+	const __m128i zero = _mm_setzero_si128();
+	uint64_t res = 0;
+	uint64_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		auto v = _mm_loadu_si128((const __m128i*) (bytes + i));
+		res += _mm_popcnt_u32(_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)));
+	}
+	return res + count_zeros_generic(bytes + i, n - i);
+}
+
+TARGET static bool is_ascii_sse42(const uint8_t *bytes, uint64_t n) {
+	__m128i high = _mm_setzero_si128();
+	uint64_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		high = _mm_or_si128(high, _mm_loadu_si128((const __m128i*) (bytes + i)));
+	}
+	return _mm_movemask_epi8(high) == 0 && is_ascii_generic(bytes + i, n - i);
+}
+
+// 16 flags at a time: every output byte picks its input byte with a shuffle and tests its bit
+TARGET static void unpack_bits_sse42(const uint8_t *src, uint64_t n,
+		uint8_t *dst) {
+	const __m128i shuffle = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1,
+			1, 1, 1);
+	const __m128i bits = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8,
+			16, 32, 64, -128);
+	const __m128i one = _mm_set1_epi8(1);
+	uint64_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		uint16_t word;
+		memcpy(&word, src + i / 8, sizeof(word));
+		auto v = _mm_shuffle_epi8(_mm_cvtsi32_si128(word), shuffle);
+		v = _mm_cmpeq_epi8(_mm_and_si128(v, bits), bits);
+		_mm_storeu_si128((__m128i*) (dst + i), _mm_and_si128(v, one));
+	}
+	unpack_bits_generic(src + i / 8, n - i, dst + i);
+}
+
+void miniparquet::simd::add_sse42_kernels(Kernels &kernels) {
+	kernels.count_zeros = count_zeros_sse42;
+	kernels.is_ascii = is_ascii_sse42;
+	kernels.unpack_bits = unpack_bits_sse42;
+}
+
+#else
+
+void miniparquet::simd::add_sse42_kernels(Kernels &kernels) {
+}
+
+#endif
@@ -0,0 +1,186 @@
+#include "simd.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <algorithm>
+
+using namespace std;
+using namespace miniparquet;
+using namespace miniparquet::simd;
+
+static Level detect_level() {
+#ifdef MINIPARQUET_SIMD_X86
+	__builtin_cpu_init();
+	if (!__builtin_cpu_supports("sse4.2") || !__builtin_cpu_supports("popcnt")) {
+		return Level::GENERIC;
+	}
+	if (!__builtin_cpu_supports("avx2") || !__builtin_cpu_supports("bmi2")) {
+		return Level::SSE42;
+	}
+	if (!__builtin_cpu_supports("avx512f")
+			|| !__builtin_cpu_supports("avx512bw")) {
+		return Level::AVX2;
+	}
+	return Level::AVX512;
+#else
+	return Level::GENERIC;
+#endif
+}
+
+static Level choose_level() {
+	auto res = detect_level();
+	auto env = getenv("MINIPARQUET_SIMD");
+	if (!env) {
+		return res;
+	}
+	// the override can only lower the level, we cannot run what the CPU does not have
+	for (auto l : { Level::GENERIC, Level::SSE42, Level::AVX2, Level::AVX512 }) {
+		if (strcmp(env, level_name(l)) == 0 && l < res) {
+			res = l;
+		}
+	}
+	return res;
+}
+
+Level simd::level() {
+	static const Level res = choose_level();
+	return res;
+}
+
+const char* simd::level_name(Level level) {
+	switch (level) {
+	case Level::SSE42:
+		return "sse4.2";
+	case Level::AVX2:
+		return "avx2";
+	case Level::AVX512:
+		return "avx512";
+	default:
+		return "generic";
+	}
+}
+
+static Kernels make_kernels(Level level) {
+	Kernels res;
+	res.count_zeros = count_zeros_generic;
+	res.is_ascii = is_ascii_generic;
+	res.unpack_bits = unpack_bits_generic;
+	res.unpack32 = unpack32_generic;
+	res.gather32 = gather32_generic;
+	res.gather64 = gather64_generic;
+	if (level >= Level::SSE42) {
+		add_sse42_kernels(res);
+	}
+	if (level >= Level::AVX2) {
+		add_avx2_kernels(res);
+	}
+	if (level >= Level::AVX512) {
+		add_avx512_kernels(res);
+	}
+	return res;
+}
+
+const Kernels& simd::kernels() {
+	static const Kernels res = make_kernels(level());
+	return res;
+}
+
+uint64_t simd::count_zeros_generic(const uint8_t *bytes, uint64_t n) {
+	uint64_t res = 0;
+	for (uint64_t i = 0; i < n; i++) {
+		res += bytes[i] == 0;
+	}
+	return res;
+}
+
+bool simd::is_ascii_generic(const uint8_t *bytes, uint64_t n) {
+	uint64_t high = 0;
+	uint64_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		uint64_t word;
+		memcpy(&word, bytes + i, sizeof(word));
+		high |= word;
+	}
+	high &= 0x8080808080808080ULL;
+	for (; i < n; i++) {
+		high |= bytes[i] & 0x80;
+	}
+	return high == 0;
+}
+
+// eight output bytes for every input byte
+struct ExpandTable {
+	uint64_t table[256];
+
+	ExpandTable() {
+		for (uint32_t byte = 0; byte < 256; byte++) {
+			uint8_t expanded[8];
+			for (int bit = 0; bit < 8; bit++) {
+				expanded[bit] = (byte >> bit) & 1;
+			}
+			memcpy(&table[byte], expanded, sizeof(expanded));
+		}
+	}
+};
+
+static const ExpandTable expand_table;
+
+void simd::unpack_bits_generic(const uint8_t *src, uint64_t n, uint8_t *dst) {
+	uint64_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		memcpy(dst + i, &expand_table.table[src[i >> 3]], 8);
+	}
+	for (; i < n; i++) {
+		dst[i] = (src[i >> 3] >> (i & 7)) & 1;
+	}
+}
+
+void simd::unpack32_generic(const uint8_t *src, uint32_t bit_width,
+		uint64_t n, uint32_t *dst) {
+	if (bit_width == 0) {
+		fill(dst, dst + n, 0);
+		return;
+	}
+	const uint64_t mask = ((uint64_t) 1 << bit_width) - 1;
+	const uint64_t src_len = (n * bit_width + 7) / 8;
+	uint64_t bit = 0;
+	for (uint64_t i = 0; i < n; i++, bit += bit_width) {
+		auto byte = bit >> 3;
+		uint64_t word = 0;
+		if (byte + 8 <= src_len) {
+			memcpy(&word, src + byte, 8); // little-endian, see RleBpDecoder
+		} else {
+			for (uint64_t b = byte; b < src_len; b++) {
+				word |= (uint64_t) src[b] << ((b - byte) * 8);
+			}
+		}
+		dst[i] = (word >> (bit & 7)) & mask;
+	}
+}
+
+template<class T>
+static bool gather_generic(const T *dict, uint64_t dict_size,
+		const uint32_t *idx, const uint8_t *defined, uint64_t n, T *dst) {
+	for (uint64_t i = 0; i < n; i++) {
+		if (!defined[i]) {
+			dst[i] = 0;
+			continue;
+		}
+		if (idx[i] >= dict_size) {
+			return false;
+		}
+		dst[i] = dict[idx[i]];
+	}
+	return true;
+}
+
+bool simd::gather32_generic(const uint32_t *dict, uint64_t dict_size,
+		const uint32_t *idx, const uint8_t *defined, uint64_t n, uint32_t *dst) {
+	return gather_generic(dict, dict_size, idx, defined, n, dst);
+}
+
+bool simd::gather64_generic(const uint64_t *dict, uint64_t dict_size,
+		const uint32_t *idx, const uint8_t *defined, uint64_t n, uint64_t *dst) {
+	return gather_generic(dict, dict_size, idx, defined, n, dst);
+}
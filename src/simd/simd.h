@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MINIPARQUET_SIMD_X86 1
+#endif
+
+namespace miniparquet {
+namespace simd {
+
+// instruction set levels, each one includes the ones before it
+enum class Level {
+	GENERIC, SSE42, AVX2, AVX512
+};
+
+// the best level the CPU supports, detected once. The environment variable MINIPARQUET_SIMD
+// (generic, sse4.2, avx2 or avx512) lowers it, for testing and benchmarking.
+Level level();
+const char* level_name(Level level);
+
+// the hot loops of the decoder. Every level fills in the ones it can do better than the level below.
+struct Kernels {
+	// number of zero bytes in bytes[0, n), e.g. the nulls in definition levels
+	uint64_t (*count_zeros)(const uint8_t *bytes, uint64_t n);
+	// true if bytes[0, n) are all below 0x80, e.g. to skip UTF-8 validation
+	bool (*is_ascii)(const uint8_t *bytes, uint64_t n);
+	// expands n bit-packed flags, least significant bit first, to bytes of 0 or 1
+	void (*unpack_bits)(const uint8_t *src, uint64_t n, uint8_t *dst);
+	// unpacks n bit-packed values of bit_width bits, least significant bit first
+	void (*unpack32)(const uint8_t *src, uint32_t bit_width, uint64_t n,
+			uint32_t *dst);
+	// dst[i] = dict[idx[i]] where defined[i] is set and 0 where it is not. Returns false
+	// if a defined index is out of bounds, dst is then partially written.
+	bool (*gather32)(const uint32_t *dict, uint64_t dict_size,
+			const uint32_t *idx, const uint8_t *defined, uint64_t n,
+			uint32_t *dst);
+	bool (*gather64)(const uint64_t *dict, uint64_t dict_size,
+			const uint32_t *idx, const uint8_t *defined, uint64_t n,
+			uint64_t *dst);
+};
+
+// the kernels for level()
+const Kernels& kernels();
+
+// portable kernels, the vector versions use them for their tails
+uint64_t count_zeros_generic(const uint8_t *bytes, uint64_t n);
+bool is_ascii_generic(const uint8_t *bytes, uint64_t n);
+void unpack_bits_generic(const uint8_t *src, uint64_t n, uint8_t *dst);
+void unpack32_generic(const uint8_t *src, uint32_t bit_width, uint64_t n,
+		uint32_t *dst);
+bool gather32_generic(const uint32_t *dict, uint64_t dict_size,
+		const uint32_t *idx, const uint8_t *defined, uint64_t n, uint32_t *dst);
+bool gather64_generic(const uint64_t *dict, uint64_t dict_size,
+		const uint32_t *idx, const uint8_t *defined, uint64_t n, uint64_t *dst);
+
+// defined in kernels_*.cpp, these are compiled for their instruction sets with target attributes
+void add_sse42_kernels(Kernels &kernels);
+void add_avx2_kernels(Kernels &kernels);
+void add_avx512_kernels(Kernels &kernels);
+
+}
+}
@@ -0,0 +1,48 @@
+// Compiles the vendored snappy once more with its SSSE3 pattern copies and BMI2 tag decoding
+// switched on, in its own namespace so it cannot clash with the portable build in snappy.cc.
+// The build flags stay portable, only the functions below the target pragma use the extensions.
+#include "snappy-ssse3-bmi2.h"
+
+#ifdef MINIPARQUET_HAVE_SNAPPY_SSSE3_BMI2
+
+// everything outside of snappy is included up front, so inline functions and templates from
+// these headers are compiled for the baseline target and can be shared with the other objects
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+#include <string>
+#include <vector>
+#ifndef _WIN32  // HAVE_SYS_UIO_H, as in snappy-stubs-public.h
+#include <sys/uio.h>
+#endif
+#include <tmmintrin.h>
+#include <immintrin.h>
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("ssse3,bmi2"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("ssse3,bmi2")
+#endif
+
+#define SNAPPY_HAVE_SSSE3 1
+#define SNAPPY_HAVE_BMI2 1
+#define snappy snappy_ssse3_bmi2
+
+#include "snappy-sinksource.cc"
+#include "snappy-stubs-internal.cc"
+#include "snappy.cc"
+
+#undef snappy
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+#endif
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstddef>
+
+// snappy's decompressor built a second time with its SSSE3 and BMI2 fast paths enabled,
+// see snappy-ssse3-bmi2.cc. Only call it if the CPU has both.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MINIPARQUET_HAVE_SNAPPY_SSSE3_BMI2 1
+
+namespace snappy_ssse3_bmi2 {
+bool RawUncompress(const char *compressed, size_t compressed_length,
+		char *uncompressed);
+}
+#endif
@@ -0,0 +1,120 @@
+// tests of the C interface, built and run by make check with the test data directory as argument
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "miniparquet_c.h"
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		exit(1); \
+	} \
+} while (0)
+
+static char path[4096];
+
+static const char *data_file(const char *dir, const char *name) {
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	return path;
+}
+
+static void test_open_errors(const char *dir) {
+	mp_file *file = (mp_file*) 1;
+	CHECK(mp_open(data_file(dir, "does_not_exist.parquet"), &file) == MP_ERROR);
+	CHECK(file == NULL);
+	CHECK(strstr(mp_last_error(), "does_not_exist.parquet") != NULL);
+	CHECK(mp_open(NULL, &file) == MP_INVALID_ARGUMENT);
+}
+
+static void test_project(const char *dir) {
+	mp_file *file;
+	uint64_t ncols, nrows;
+	const mp_column *cols;
+	CHECK(mp_open(data_file(dir, "nulls.parquet"), &file) == MP_OK);
+	CHECK(mp_schema(file, &ncols, &cols, &nrows) == MP_OK);
+	CHECK(ncols == 5 && nrows == 7);
+	CHECK(strcmp(cols[0].name, "i32") == 0 && cols[0].type == MP_INT32 && cols[0].width == 4);
+	CHECK(strcmp(cols[4].name, "s") == 0 && cols[4].type == MP_BYTE_ARRAY && cols[4].width == 0);
+
+	uint64_t out_of_range[] = { 0, 5 };
+	CHECK(mp_project(file, out_of_range, 2) == MP_INVALID_ARGUMENT);
+	CHECK(strlen(mp_last_error()) > 0);
+	mp_close(file);
+}
+
+// nulls.parquet has row groups of 3, 3 and 1 rows, i32 is 1 NULL 3 | -4 NULL 6 | 7 and
+// s is a bb NULL | a ccc bb | NULL
+static void test_batches(const char *dir) {
+	mp_file *file;
+	CHECK(mp_open(data_file(dir, "nulls.parquet"), &file) == MP_OK);
+	uint64_t col_ids[] = { 4, 0 };
+	CHECK(mp_project(file, col_ids, 2) == MP_OK);
+
+	char strings[3];
+	int64_t offsets[3];
+	uint8_t s_defined[2];
+	int32_t ints[2];
+	uint8_t i_defined[2];
+	mp_buffer buffers[2];
+	memset(buffers, 0, sizeof(buffers));
+	buffers[0].values = strings;
+	buffers[0].values_size = sizeof(strings);
+	buffers[0].offsets = offsets;
+	buffers[0].defined = s_defined;
+	buffers[1].values = ints;
+	buffers[1].defined = i_defined;
+
+	// batches end at the capacity of 2, at row groups and where the strings stop fitting into 3 bytes
+	const char *expected_strings[] = { "abb", "", "a", "ccc", "bb", "" };
+	const uint64_t expected_rows[] = { 2, 1, 1, 1, 1, 1 };
+	const int32_t expected_ints[] = { 1, 0, 3, -4, 0, 6, 7 };
+	const uint8_t expected_defined[] = { 1, 0, 1, 1, 0, 1, 1 };
+	uint64_t row = 0;
+	for (int batch = 0; batch < 6; batch++) {
+		uint64_t nrows;
+		memset(ints, 0xff, sizeof(ints));
+		CHECK(mp_scan_next_batch(file, buffers, 2, &nrows) == MP_OK);
+		CHECK(nrows == expected_rows[batch]);
+		CHECK(offsets[0] == 0);
+		CHECK((size_t) offsets[nrows] == strlen(expected_strings[batch]));
+		CHECK(memcmp(strings, expected_strings[batch], offsets[nrows]) == 0);
+		for (uint64_t i = 0; i < nrows; i++) {
+			// NULL rows read back zeroed
+			CHECK(ints[i] == expected_ints[row + i]);
+			CHECK(i_defined[i] == expected_defined[row + i]);
+		}
+		row += nrows;
+	}
+	CHECK(row == 7);
+	CHECK(s_defined[0] == 0);
+	uint64_t nrows = 1;
+	CHECK(mp_scan_next_batch(file, buffers, 2, &nrows) == MP_OK);
+	CHECK(nrows == 0);
+
+	// ccc does not fit into 2 bytes even at the start of a batch
+	buffers[0].values_size = 2;
+	CHECK(mp_project(file, col_ids, 1) == MP_OK);
+	const uint64_t small_rows[] = { 1, 2, 1 };
+	for (int batch = 0; batch < 3; batch++) {
+		CHECK(mp_scan_next_batch(file, buffers, 2, &nrows) == MP_OK);
+		CHECK(nrows == small_rows[batch]);
+	}
+	CHECK(mp_scan_next_batch(file, buffers, 2, &nrows) == MP_BUFFER_TOO_SMALL);
+	CHECK(nrows == 0);
+	CHECK(strlen(mp_last_error()) > 0);
+	mp_close(file);
+}
+
+int main(int argc, char **argv) {
+	if (argc != 2) {
+		fprintf(stderr, "Usage: %s test-data-directory\n", argv[0]);
+		return 2;
+	}
+	test_open_errors(argv[1]);
+	test_project(argv[1]);
+	test_batches(argv[1]);
+	printf("C interface tests passed\n");
+	return 0;
+}
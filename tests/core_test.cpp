@@ -0,0 +1,159 @@
+// tests of the C++ reader, built and run by make check with the test data directory as argument
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "miniparquet.h"
+
+using namespace miniparquet;
+using namespace std;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		exit(1); \
+	} \
+} while (0)
+
+static string read_file(const string &fname) {
+	ifstream in(fname, ios::binary);
+	CHECK(in.good());
+	stringstream ss;
+	ss << in.rdbuf();
+	return ss.str();
+}
+
+// scans all row groups, returns the error message or an empty string
+static string scan_all(ParquetFile &f, bool verify_crc) {
+	ResultChunk rc;
+	ScanState s;
+	s.verify_crc = verify_crc;
+	f.initialize_result(rc);
+	try {
+		while (f.scan(s, rc)) {
+		}
+	} catch (std::exception &e) {
+		return e.what();
+	}
+	return "";
+}
+
+// checksums.parquet has page checksums, uncompressed pages and two row groups of
+// i int64, s string, d double
+static string corrupt_checksums_file(const string &dir, uint64_t &page_offset) {
+	auto content = read_file(dir + "/checksums.parquet");
+	ParquetFile f(content.data(), content.size());
+	auto &meta_data = f.meta_data().row_groups[1].columns[2].meta_data;
+	// the last byte of the chunk is in the values of its data page
+	auto chunk_start = meta_data.__isset.dictionary_page_offset ?
+			meta_data.dictionary_page_offset : meta_data.data_page_offset;
+	content[chunk_start + meta_data.total_compressed_size - 1] ^= 0x10;
+	page_offset = meta_data.data_page_offset;
+	return content;
+}
+
+static void test_crc(const string &dir) {
+	auto content = read_file(dir + "/checksums.parquet");
+	ParquetFile f(content.data(), content.size());
+	CHECK(scan_all(f, true) == "");
+
+	uint64_t page_offset;
+	auto corrupt = corrupt_checksums_file(dir, page_offset);
+	ParquetFile corrupt_f(corrupt.data(), corrupt.size());
+	// without verification the flipped bit only changes a value
+	CHECK(scan_all(corrupt_f, false) == "");
+	auto error = scan_all(corrupt_f, true);
+	CHECK(error.find("checksum mismatch") != string::npos);
+	CHECK(error.find("Column d") != string::npos);
+	CHECK(error.find("offset " + to_string(page_offset)) != string::npos);
+}
+
+// runs command, returns its exit status and standard output
+static int run(const string &command, string &output) {
+	auto pipe = popen(command.c_str(), "r");
+	CHECK(pipe);
+	char buf[4096];
+	size_t n;
+	output.clear();
+	while ((n = fread(buf, 1, sizeof(buf), pipe)) > 0) {
+		output.append(buf, n);
+	}
+	auto status = pclose(pipe);
+	CHECK(WIFEXITED(status));
+	return WEXITSTATUS(status);
+}
+
+static void test_pqcheck(const string &dir, const string &pqcheck) {
+	string output;
+	CHECK(run(pqcheck + " " + dir + "/checksums.parquet", output) == 0);
+	CHECK(output.find(": OK, 1000 rows, 3 columns, 2 row groups") != string::npos);
+
+	uint64_t page_offset;
+	auto corrupt = corrupt_checksums_file(dir, page_offset);
+	char fname[] = "/tmp/miniparquet_corrupt_XXXXXX";
+	auto fd = mkstemp(fname);
+	CHECK(fd >= 0);
+	CHECK(write(fd, corrupt.data(), corrupt.size()) == (ssize_t) corrupt.size());
+	close(fd);
+	auto status = run(pqcheck + " " + fname, output);
+	unlink(fname);
+	CHECK(status == 1);
+	CHECK(output.find("FAILED") != string::npos);
+	CHECK(output.find("Column d, row group 1") != string::npos);
+	CHECK(output.find("offset " + to_string(page_offset)) != string::npos);
+}
+
+// custom_codec.parquet is alltypes_plain.parquet with pages that are stored as they are but
+// marked as BROTLI, which is not built in
+struct StoredCodec: public Codec {
+	static int calls;
+	void decompress(const char *src, uint64_t src_len, char *dst,
+			uint64_t dst_len) override {
+		CHECK(src_len == dst_len);
+		memcpy(dst, src, dst_len);
+		calls++;
+	}
+};
+
+int StoredCodec::calls = 0;
+
+static void test_register_codec(const string &dir) {
+	auto fname = dir + "/custom_codec.parquet";
+	ParquetFile f(fname);
+	CHECK(scan_all(f, false).find("Unsupported compression codec BROTLI") != string::npos);
+
+	register_codec(parquet::format::CompressionCodec::BROTLI, []() {
+		return unique_ptr<Codec>(new StoredCodec());
+	});
+	ResultChunk rc;
+	ScanState s;
+	f.initialize_result(rc);
+	CHECK(f.scan(s, rc));
+	// a dictionary and a data page per column, bool_col has no dictionary
+	CHECK(StoredCodec::calls == 2 * (int) f.columns.size() - 1);
+	CHECK(rc.nrows == 8);
+	CHECK(((int32_t*) rc.cols[0].data.ptr)[0] == 4);
+	CHECK(strcmp(((char**) rc.cols[9].data.ptr)[1], "1") == 0);
+
+	register_codec(parquet::format::CompressionCodec::BROTLI, nullptr);
+	CHECK(scan_all(f, false).find("Unsupported compression codec") != string::npos);
+}
+
+int main(int argc, char **argv) {
+	if (argc != 3) {
+		fprintf(stderr, "Usage: %s test-data-directory pqcheck\n", argv[0]);
+		return 2;
+	}
+	test_crc(argv[1]);
+	test_pqcheck(argv[1], argv[2]);
+	test_register_codec(argv[1]);
+	printf("C++ tests passed\n");
+	return 0;
+}
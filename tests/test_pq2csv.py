@@ -0,0 +1,191 @@
+#!/usr/bin/env python3
+# compares the output of pq2csv with pyarrow, run after make with
+#   python3 tests/test_pq2csv.py
+
+import csv
+import decimal
+import io
+import os
+import random
+import struct
+import subprocess
+import sys
+import tempfile
+import unittest
+
+try:
+    import numpy as np
+    import pyarrow as pa
+    import pyarrow.parquet as pq
+except ImportError:
+    print('pq2csv tests need numpy and pyarrow, skipped')
+    sys.exit(0)
+
+pq2csv = os.path.join(os.path.dirname(__file__), '..', 'pq2csv')
+
+
+def run(*args):
+    return subprocess.run([pq2csv] + [str(a) for a in args], check=True, capture_output=True).stdout
+
+
+def format_value(v, typ, null='NULL', delimiter='\t'):
+    if v is None:
+        return null
+    if pa.types.is_boolean(typ):
+        return 'True' if v else 'False'
+    if pa.types.is_float32(typ):
+        # the shortest digits that read back as the same float, laid out like repr()
+        return repr(float(np.format_float_scientific(np.float32(v), unique=True)))
+    if pa.types.is_floating(typ):
+        return repr(v)
+    if pa.types.is_decimal(typ):
+        return format(v, 'f')
+    if pa.types.is_string(typ):
+        if any(c in v for c in ['"', '\r', '\n']) or (delimiter and delimiter in v):
+            return '"' + v.replace('"', '""') + '"'
+        return v
+    return str(v)
+
+
+def expected(table, rows=None, columns=None, null='NULL', delimiter='\t'):
+    columns = columns or table.column_names
+    values = {name: table.column(name).to_pylist() for name in columns}
+    types = {name: table.schema.field(name).type for name in columns}
+    rows = range(table.num_rows) if rows is None else rows
+    return ''.join(delimiter.join(format_value(values[name][row], types[name], null, delimiter) for name in columns)
+                   + '\n' for row in rows).encode()
+
+
+def random_doubles(n):
+    res = [struct.unpack('<d', struct.pack('<Q', random.getrandbits(64)))[0] for _ in range(n)]
+    res += [0.0, -0.0, 0.1, 0.1 + 0.2, 1e16, 1e22, 1e23, 5e-324, 2.2250738585072014e-308, 1.7976931348623157e308,
+            123456789.123, float('inf'), float('-inf'), 1 / 3]
+    res += [2.0 ** e for e in range(-1074, 1024)]
+    return res
+
+
+def random_floats(n):
+    res = [float(np.frombuffer(struct.pack('<I', random.getrandbits(32)), dtype=np.float32)[0]) for _ in range(n)]
+    res += [0.0, -0.0, 1.1, 16777216.0, 1e-45, 3.4028234663852886e38, 123456789.0, float('inf')]
+    return [v for v in res if v == v]
+
+
+class Pq2csvTest(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls):
+        random.seed(42)
+        cls.dir = tempfile.TemporaryDirectory()
+        cls.files = {}
+
+        doubles = [v for v in random_doubles(40000) if v == v]
+        floats = random_floats(len(doubles))
+        floats = (floats * 2)[:len(doubles)]
+        cls.add('floats', pa.table({'d': pa.array(doubles, pa.float64()), 'f': pa.array(floats, pa.float32())}),
+                row_group_size=15000)
+
+        def decimals(precision, scale, n):
+            res = [decimal.Decimal(random.randrange(-10 ** precision + 1, 10 ** precision)).scaleb(-scale)
+                   for _ in range(n)]
+            res += [decimal.Decimal(v).scaleb(-scale) for v in [10 ** precision - 1, -10 ** precision + 1, 0]]
+            res.append(None)
+            return pa.array(res, pa.decimal128(precision, scale))
+        decimal.getcontext().prec = 100
+        cls.add('decimals', pa.table({'d9': decimals(9, 2, 2000), 'd18': decimals(18, 18, 2000),
+                                      'd38': decimals(38, 10, 2000), 'd38_0': decimals(38, 0, 2000),
+                                      'd20': decimals(20, 3, 2000)}), use_dictionary=False)
+
+        n = 50
+        cls.add('mixed', pa.table({
+            'i': pa.array([None if i % 7 == 3 else i * 3 - 40 for i in range(n)], pa.int32()),
+            'l': pa.array([i * 10 ** 12 if i % 5 else None for i in range(n)], pa.int64()),
+            'b': pa.array([None if i % 11 == 0 else i % 3 == 0 for i in range(n)]),
+            'x': pa.array([i / 4 if i % 6 else None for i in range(n)], pa.float64()),
+            's': pa.array([None if i % 9 == 0 else ['a', 'b,c', 'd\ne', 'f"g', 'h\ti', 'j'][i % 6] + str(i)
+                           for i in range(n)]),
+            'u64': pa.array([[1, 2 ** 63 + 5, 3, 2 ** 64 - 1][i % 4] + (i // 4) * (i % 2 == 0) for i in range(n)],
+                            pa.uint64()),
+            'u32': pa.array([[1, 4000000000, 3, 2 ** 32 - 1][i % 4] for i in range(n)], pa.uint32()),
+            'u8': pa.array([(i * 37) % 256 for i in range(n)], pa.uint8())}), row_group_size=7)
+
+    @classmethod
+    def add(cls, name, table, **kwargs):
+        fname = os.path.join(cls.dir.name, name + '.parquet')
+        pq.write_table(table, fname, **kwargs)
+        cls.files[name] = (fname, table)
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.dir.cleanup()
+
+    def test_shortest_floats(self):
+        fname, table = self.files['floats']
+        self.assertEqual(run(fname), expected(table))
+
+    def test_decimals(self):
+        fname, table = self.files['decimals']
+        self.assertEqual(run(fname), expected(table))
+
+    def test_nulls(self):
+        fname, table = self.files['mixed']
+        self.assertEqual(run(fname), expected(table))
+        self.assertEqual(run('--null', 'NA', fname), expected(table, null='NA'))
+        self.assertEqual(run('--null', '', fname), expected(table, null=''))
+
+    def test_columns(self):
+        fname, table = self.files['mixed']
+        self.assertEqual(run('--columns', 's,i,u64', fname), expected(table, columns=['s', 'i', 'u64']))
+        with self.assertRaises(subprocess.CalledProcessError):
+            run('--columns', 'nope', fname)
+
+    def test_offset_limit(self):
+        # row groups of 7 rows, offsets and limits fall inside them, at their edges and across files
+        fname, table = self.files['mixed']
+        for offset, limit in [(0, 1), (3, 4), (7, 7), (6, 9), (13, 100), (49, 10), (50, 1), (0, 0), (20, 17)]:
+            self.assertEqual(run('--offset', offset, '--limit', limit, fname),
+                             expected(table, rows=range(offset, min(offset + limit, table.num_rows))),
+                             (offset, limit))
+        self.assertEqual(run('--offset', 45, '--limit', 10, fname, fname),
+                         expected(table, rows=range(45, 50)) + expected(table, rows=range(5)))
+        self.assertEqual(run('--offset', 45, '--limit', 10, '--columns', 'i,u8', fname, fname),
+                         expected(table, rows=list(range(45, 50)) + list(range(5)), columns=['i', 'u8']))
+
+    def test_threads(self):
+        for name in ['floats', 'decimals', 'mixed']:
+            fname, table = self.files[name]
+            single = run('--threads', 1, fname, fname)
+            for threads in [2, 3, 8]:
+                self.assertEqual(run('--threads', threads, fname, fname), single, (name, threads))
+
+    def test_where(self):
+        fname, table = self.files['mixed']
+        values = {name: table.column(name).to_pylist() for name in table.column_names}
+        ops = {'==': lambda a, b: a == b, '!=': lambda a, b: a != b, '<': lambda a, b: a < b,
+               '<=': lambda a, b: a <= b, '>': lambda a, b: a > b, '>=': lambda a, b: a >= b}
+        conditions = [[('i', '>', 10)], [('i', '<=', -10)], [('i', '!=', 20)], [('l', '>=', 3 * 10 ** 13)],
+                      [('x', '<', 5.5)], [('s', '==', 'j5')], [('s', '>', 'd')], [('b', '==', True)],
+                      [('i', '>', 0), ('s', '!=', 'a6')],
+                      # unsigned values above the signed maximum
+                      [('u64', '>', 10)], [('u64', '==', 2 ** 64 - 1)], [('u64', '<', 2 ** 63)],
+                      [('u64', '>=', 2 ** 63 + 5)], [('u32', '>', 3)], [('u32', '==', 4000000000)], [('u8', '>', 200)]]
+        for conds in conditions:
+            args = []
+            for col, op, value in conds:
+                args += ['--where', '%s %s %s' % (col, op, str(value).lower() if isinstance(value, bool) else value)]
+            # like SQL, NULL never matches
+            rows = [r for r in range(table.num_rows)
+                    if all(values[col][r] is not None and ops[op](values[col][r], value) for col, op, value in conds)]
+            self.assertTrue(rows, conds)
+            self.assertEqual(run(*(args + [fname])), expected(table, rows=rows), conds)
+            self.assertEqual(run(*(args + ['--offset', 1, '--limit', 2, fname])), expected(table, rows=rows[1:3]),
+                             conds)
+
+    def test_csv_quoting(self):
+        fname, table = self.files['mixed']
+        res = run('--delimiter', ',', '--columns', 's,i', fname).decode()
+        self.assertEqual(res.encode(), expected(table, columns=['s', 'i'], delimiter=','))
+        parsed = list(csv.reader(io.StringIO(res, newline='')))
+        self.assertEqual([row[0] for row in parsed], [v or 'NULL' for v in table.column('s').to_pylist()])
+
+
+if __name__ == '__main__':
+    unittest.main()
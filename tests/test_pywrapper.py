@@ -0,0 +1,254 @@
+#!/usr/bin/env python3
+# tests of the Python module, run after building it in place with
+#   python3 setup.py build_ext --inplace && python3 tests/test_pywrapper.py
+
+import functools
+import gc
+import http.server
+import os
+import re
+import sys
+import threading
+import unittest
+
+import numpy as np
+
+try:
+    import pyarrow as pa
+    import pyarrow.parquet as pq
+except ImportError:
+    pa = None
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), '..'))
+import miniparquet
+
+data = os.path.join(os.path.dirname(__file__), 'data')
+
+
+class NumpyTest(unittest.TestCase):
+    def test_dtypes(self):
+        res = miniparquet.read(os.path.join(data, 'alltypes_plain.parquet'))
+        self.assertEqual({k: v.dtype for k, v in res.items()},
+                         {'id': np.int32, 'bool_col': np.bool_, 'tinyint_col': np.int32, 'smallint_col': np.int32,
+                          'int_col': np.int32, 'bigint_col': np.int64, 'float_col': np.float32,
+                          'double_col': np.float64, 'date_string_col': object, 'string_col': object,
+                          'timestamp_col': np.dtype('datetime64[ns]')})
+        self.assertEqual(res['id'].tolist(), [4, 5, 6, 7, 2, 3, 0, 1])
+        self.assertEqual(res['bool_col'].tolist(), [True, False] * 4)
+        self.assertEqual(res['string_col'].tolist(), ['0', '1'] * 4)
+        self.assertEqual(res['timestamp_col'][:2].tolist(),
+                         [np.datetime64('2009-03-01T00:00:00', 'ns').astype(int),
+                          np.datetime64('2009-03-01T00:01:00', 'ns').astype(int)])
+
+    def test_nulls_are_masked(self):
+        res = miniparquet.read(os.path.join(data, 'nulls.parquet'))
+        for name in ['i32', 'f64', 'b', 'i64']:
+            self.assertIsInstance(res[name], np.ma.MaskedArray, name)
+        self.assertEqual(res['i32'].tolist(), [1, None, 3, -4, None, 6, 7])
+        self.assertEqual(res['f64'].tolist(), [1.5, 2.5, None, None, 5.5, -6.5, 7.5])
+        self.assertEqual(res['b'].tolist(), [True, None, False, True, False, None, True])
+        self.assertEqual(res['i64'].tolist(), [None, 20, 30, 40, 50, None, -70])
+        # strings have None instead of a mask
+        self.assertNotIsInstance(res['s'], np.ma.MaskedArray)
+        self.assertEqual(res['s'].tolist(), ['a', 'bb', None, 'a', 'ccc', 'bb', None])
+
+    def test_columns_without_nulls_are_not_masked(self):
+        res = miniparquet.read(os.path.join(data, 'alltypes_plain.parquet'))
+        self.assertFalse(any(isinstance(v, np.ma.MaskedArray) for v in res.values()))
+
+
+def as_lists(res):
+    return {k: v.tolist() for k, v in res.items()}
+
+
+class ThreadsTest(unittest.TestCase):
+    def test_threads_give_the_same_result(self):
+        # nulls.parquet has three row groups
+        fname = os.path.join(data, 'nulls.parquet')
+        with open(fname, 'rb') as f:
+            content = f.read()
+        for source in [fname, [fname] * 4, [content, fname]]:
+            ref = as_lists(miniparquet.read(source))
+            for threads in [2, 4, 16]:
+                self.assertEqual(as_lists(miniparquet.read(source, threads=threads)), ref, threads)
+
+    def test_list_is_read_as_one_table(self):
+        one = as_lists(miniparquet.read(os.path.join(data, 'nulls.parquet')))
+        three = as_lists(miniparquet.read([os.path.join(data, 'nulls.parquet')] * 3, threads=3))
+        self.assertEqual(three, {k: v * 3 for k, v in one.items()})
+
+    def test_invalid_threads(self):
+        with self.assertRaises(ValueError):
+            miniparquet.read(os.path.join(data, 'nulls.parquet'), threads=0)
+
+
+class ParquetFileTest(unittest.TestCase):
+    def setUp(self):
+        self.f = miniparquet.ParquetFile(os.path.join(data, 'nulls.parquet'))
+
+    def test_num_rows_schema_metadata(self):
+        self.assertEqual(self.f.num_rows, 7)
+        self.assertEqual(self.f.schema, {'i32': np.int32, 'f64': np.float64, 'b': np.bool_, 'i64': np.int64,
+                                         's': object})
+        meta = self.f.metadata
+        self.assertEqual(meta['num_rows'], 7)
+        self.assertEqual([rg['num_rows'] for rg in meta['row_groups']], [3, 3, 1])
+        self.assertIn('ARROW:schema', meta['key_value_metadata'])
+
+    def test_iter_batches(self):
+        batches = [as_lists(b) for b in self.f.iter_batches()]
+        self.assertEqual([b['i32'] for b in batches], [[1, None, 3], [-4, None, 6], [7]])
+        self.assertEqual(as_lists(miniparquet.read(os.path.join(data, 'nulls.parquet'))),
+                         {k: sum((b[k] for b in batches), []) for k in batches[0]})
+
+    def test_iter_batches_columns_and_batch_size(self):
+        batches = [as_lists(b) for b in self.f.iter_batches(columns=['s', 'i32'], batch_size=2)]
+        self.assertEqual([list(b.keys()) for b in batches], [['s', 'i32']] * len(batches))
+        self.assertEqual([b['i32'] for b in batches], [[1, None], [3], [-4, None], [6], [7]])
+        self.assertEqual([b['s'] for b in batches], [['a', 'bb'], [None], ['a', 'ccc'], ['bb'], [None]])
+        with self.assertRaises(KeyError):
+            list(self.f.iter_batches(columns=['nope']))
+
+
+class FilterTest(unittest.TestCase):
+    def setUp(self):
+        self.f = miniparquet.ParquetFile(os.path.join(data, 'nulls.parquet'))
+
+    def filtered(self, filter):
+        return {k: sum((as_lists(b)[k] for b in self.f.iter_batches(filter=filter)), []) for k in self.f.schema}
+
+    def test_filter(self):
+        self.assertEqual(self.filtered([('i32', '>', 3)])['i32'], [6, 7])
+        self.assertEqual(self.filtered([('i32', '>=', 3), ('f64', '<', 0)])['i32'], [6])
+        self.assertEqual(self.filtered([('s', '==', 'bb')])['i64'], [20, None])
+        self.assertEqual(self.filtered([('b', '==', False)])['i32'], [3, None])
+
+    def test_filter_drops_null_rows(self):
+        # like SQL, a comparison with NULL is never true, not even !=
+        self.assertEqual(self.filtered([('i32', '!=', 3)])['i32'], [1, -4, 6, 7])
+        self.assertEqual(self.filtered([('s', '!=', 'a')])['s'], ['bb', 'ccc', 'bb'])
+
+    def test_invalid_filter(self):
+        with self.assertRaises(ValueError):
+            list(self.f.iter_batches(filter=[('i32', '~', 1)]))
+
+    def test_unsigned_statistics_do_not_prune(self):
+        # u is a uint32 column [10, 3000000000] in one row group, its statistics are in unsigned order
+        f = miniparquet.ParquetFile(os.path.join(data, 'unsigned.parquet'))
+        for op, value in [('==', 10), ('>', 5)]:
+            batches = list(f.iter_batches(filter=[('u', op, value)]))
+            self.assertEqual([list(b['v']) for b in batches], [[1]], (op, value))
+
+
+class DictionaryTest(unittest.TestCase):
+    def test_repeated_strings_are_one_object(self):
+        # date_string_col is dictionary encoded in a single row group
+        res = miniparquet.read(os.path.join(data, 'alltypes_plain.parquet'))['date_string_col']
+        self.assertEqual(res.tolist(), ['03/01/09', '03/01/09', '04/01/09', '04/01/09', '02/01/09', '02/01/09',
+                                        '01/01/09', '01/01/09'])
+        for i in range(0, len(res), 2):
+            self.assertIs(res[i], res[i + 1])
+        self.assertIsNot(res[0], res[2])
+
+
+@unittest.skipIf(pa is None, 'needs pyarrow')
+class ArrowStreamTest(unittest.TestCase):
+    def test_round_trip(self):
+        for name in ['alltypes_plain.parquet', 'alltypes_plain.snappy.parquet', 'nulls.parquet']:
+            f = miniparquet.ParquetFile(os.path.join(data, name))
+            reader = pa.RecordBatchReader.from_stream(f)
+            # the stream keeps the file open
+            del f
+            res = reader.read_all()
+            self.assertTrue(res.equals(pq.read_table(os.path.join(data, name))), name)
+
+    def test_one_batch_per_row_group(self):
+        reader = pa.RecordBatchReader.from_stream(miniparquet.ParquetFile(os.path.join(data, 'nulls.parquet')))
+        self.assertEqual([b.num_rows for b in reader], [3, 3, 1])
+
+
+class RowGroupBuffersTest(unittest.TestCase):
+    def test_buffers_outlive_the_file(self):
+        f = miniparquet.ParquetFile(os.path.join(data, 'nulls.parquet'))
+        buffers = f.row_group_buffers(1)
+        del f
+        gc.collect()
+        self.assertEqual(sorted(buffers), ['b', 'f64', 'i32', 'i64'])
+        expected = {'i32': ('i', [-4, None, 6]), 'f64': ('d', [None, 5.5, -6.5]), 'b': ('?', [True, False, None]),
+                    'i64': ('q', [40, 50, None])}
+        for name, (fmt, values) in expected.items():
+            view, valid = buffers[name]
+            self.assertEqual((view.format, valid.format, len(view), len(valid)), (fmt, '?', 3, 3), name)
+            # values of NULL rows are undefined
+            self.assertEqual([v if ok else None for v, ok in zip(view.tolist(), valid.tolist())], values, name)
+            self.assertTrue(view.readonly)
+
+    def test_selected_columns(self):
+        f = miniparquet.ParquetFile(os.path.join(data, 'alltypes_plain.parquet'))
+        buffers = f.row_group_buffers(0, columns=['bigint_col', 'id'])
+        self.assertEqual(list(buffers), ['bigint_col', 'id'])
+        self.assertEqual(np.frombuffer(buffers['id'][0], dtype=np.int32).tolist(), [4, 5, 6, 7, 2, 3, 0, 1])
+        with self.assertRaises(ValueError):
+            f.row_group_buffers(0, columns=['string_col'])
+        with self.assertRaises(IndexError):
+            f.row_group_buffers(1)
+
+
+class CountingHandler(http.server.SimpleHTTPRequestHandler):
+    # like python3 -m http.server, which ignores Range headers and always sends the whole file
+    requests = 0
+    protocol_version = 'HTTP/1.1'
+
+    def do_GET(self):
+        type(self).requests += 1
+        super().do_GET()
+
+    def log_message(self, *args):
+        pass
+
+
+class RangeHandler(CountingHandler):
+    def do_GET(self):
+        type(self).requests += 1
+        with open(self.translate_path(self.path), 'rb') as f:
+            content = f.read()
+        first, last = re.match(r'bytes=(\d*)-(\d*)', self.headers['Range']).groups()
+        if first == '':
+            first, last = max(len(content) - int(last), 0), len(content) - 1
+        else:
+            first, last = int(first), min(int(last or len(content) - 1), len(content) - 1)
+        self.send_response(206)
+        self.send_header('Content-Range', 'bytes %d-%d/%d' % (first, last, len(content)))
+        self.send_header('Content-Length', str(last - first + 1))
+        self.end_headers()
+        self.wfile.write(content[first:last + 1])
+
+
+class HttpTest(unittest.TestCase):
+    def read_over(self, handler, name):
+        handler.requests = 0
+        server = http.server.ThreadingHTTPServer(('127.0.0.1', 0), functools.partial(handler, directory=data))
+        thread = threading.Thread(target=server.serve_forever)
+        thread.start()
+        try:
+            res = miniparquet.read('http://127.0.0.1:%d/%s' % (server.server_port, name))
+        finally:
+            server.shutdown()
+            server.server_close()
+            thread.join()
+        ref = miniparquet.read(os.path.join(data, name))
+        self.assertEqual(list(res.keys()), list(ref.keys()))
+        for k in ref:
+            self.assertEqual(list(res[k]), list(ref[k]), k)
+
+    def test_server_without_ranges_sends_the_file_once(self):
+        self.read_over(CountingHandler, 'alltypes_plain.parquet')
+        self.assertEqual(CountingHandler.requests, 1)
+
+    def test_server_with_ranges(self):
+        self.read_over(RangeHandler, 'alltypes_plain.snappy.parquet')
+        self.assertGreater(RangeHandler.requests, 1)
+
+
+if __name__ == '__main__':
+    unittest.main()